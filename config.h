@@ -25,6 +25,13 @@
  */
 #define DEBUG
 
+/*
+ * How much to log over the serial port when DEBUG is on: LOG_LEVEL_ERROR
+ * for failures, LOG_LEVEL_INFO for what the weather and lights are doing
+ * too, or LOG_LEVEL_DEBUG for every HTTP request's headers and states.
+ */
+#define LOG_LEVEL LOG_LEVEL_INFO
+
 /*
  * Put your wifi network name and passphrase here.
  */
@@ -42,11 +49,28 @@
 #define NWS_LOCATION   "Durham NC"
 #define NWS_USER_AGENT "pufflux/1 https://github.com/sterwill/pufflux"
 
+/*
+ * Optionally fetch alerts for a whole NWS forecast zone or county (like
+ * "NCZ041" or "NCC063") instead of for the exact location.  Zone queries
+ * are the same for everyone in the zone, so the NWS can answer them from
+ * its cache, but they include storm-based alerts whose polygons don't
+ * cover us.  Pufflux tests those polygons against the location itself
+ * and ignores the alerts that don't apply.
+ */
+//#define NWS_ALERT_ZONE "NCZ041"
+
 /* 
  * Fetch the weather forecast every this many minutes. 
  */
 #define FORECAST_PERIOD_MINUTES 15
 
+/*
+ * When there are no active alerts, show the hourly forecast (temperature
+ * and chance of precipitation) for this many hours.  Set it to 0 to show
+ * the default random color animation instead.
+ */
+#define FORECAST_HOURS 12
+
 /*
  * LEDs are a single 68-element NeoPixel strip that forms a circle
  * around the chassis:
@@ -61,10 +85,58 @@
  *       front |
  */
 
-// Pin the NeoPixel strip is connected to
-#define LED_PIN    1
+/*
+ * Where the runs of LEDs in that diagram are, for animations that move
+ * across the cloud's shape.  Each is { first LED, LED count, x of the
+ * first LED, x of the last, y }, with x in LED spacings from the left end
+ * and y in diagram rows from the front (0) to the back (4).
+ * LED_LAYOUT_WIDTH and LED_LAYOUT_DEPTH are the largest x and y.
+ */
+#define LED_LAYOUT { \
+  {  0, 12,  0, 11, 0 }, \
+  { 12, 10, 12, 21, 1 }, \
+  { 22, 12, 22, 33, 0 }, \
+  { 34, 12, 33, 22, 4 }, \
+  { 46, 10, 21, 12, 3 }, \
+  { 56, 12, 11,  0, 4 }, \
+}
+#define LED_LAYOUT_WIDTH 33
+#define LED_LAYOUT_DEPTH 4
+
+/*
+ * The NeoPixel strips the lights are on, in the order their LEDs are
+ * numbered, as LED_STRIP(pin, LED count, type, reversed).  List more than
+ * one, separated by commas, to drive several strips; LED_COUNT must be
+ * their total.  A reversed strip is wired from its far end.
+ */
+#define LED_STRIPS LED_STRIP(1, 68, NEO_GRB + NEO_KHZ800, false)
 
-// Number of NeoPixels on the strip
+// Number of NeoPixels on all the strips
 #define LED_COUNT  68
 
+// Brightness cap for the whole strip, 0-255
+#define LIGHTS_BRIGHTNESS 255
+
+/*
+ * If defined, the lights report what their frames cost over the serial
+ * port every this many seconds: time spent animating, compositing and
+ * showing, and how many LEDs were blended and sent, along with each
+ * layer's animation and speed.
+ */
+//#define LIGHTS_BENCHMARK_SECONDS 10
+
+/*
+ * If defined, times the main loop's tasks, the phases of each light frame
+ * and of each HTTP request, and keeps a histogram for each.  Send 'p' over
+ * the serial port to print them.  It also tracks how deep the stack goes
+ * during each weather request and one light frame in every few hundred;
+ * send 'm' to print that and how the heap is doing.
+ */
+//#define PROFILE
+
+// Frames per second to draw the lights at.  Animations that need to move
+// faster (or can get away with slower) ask for their own rate; between
+// frames the loop is free for other work.
+#define LIGHTS_FRAME_RATE 50
+
 #endif /* __CONFIG_H_ */
@@ -0,0 +1,83 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Times frames of the lights as they were before the scheduler, when
+ * lights_loop() drew one frame every time loop() called it.  Built by
+ * bench_revisions.sh against lights.cpp from an old revision, so older
+ * designs can be compared on the same host.  Each animation runs fast and
+ * slow for the given number of frames, 20 ms apart on the virtual clock,
+ * and reports the host's time per frame in the quickest tenth of them.
+ *
+ *   bench_frames [frames]
+ */
+
+#include <Arduino.h>
+#include <time.h>
+
+#include "lights.h"
+
+#define BATCHES 10
+
+static const char *anim_names[] = {
+  "default", "precip", "flood", "pulse", "swirl", "forecast",
+};
+
+// A wet afternoon, for ANIM_FORECAST
+static const forecast_hour sample_forecast[] = {
+  {72, 0, COLOR_BLACK}, {73, 0, COLOR_BLACK}, {73, 2, COLOR_BLACK}, {73, 5, COLOR_BLACK},
+  {72, 15, COLOR_BLUE}, {70, 24, COLOR_BLUE}, {68, 40, COLOR_YELLOW}, {65, 55, COLOR_YELLOW},
+  {62, 70, COLOR_YELLOW}, {58, 62, COLOR_BLUE}, {56, 35, COLOR_BLACK}, {53, 20, COLOR_BLACK},
+};
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  unsigned long frames = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+
+  randomSeed(90);
+  lights_setup();
+  lights_set_forecast(sample_forecast, sizeof(sample_forecast) / sizeof(sample_forecast[0]));
+
+  printf("%-9s %s %9s\n", "animation", "mode", "ns/frame");
+  for (int a = 0; a < (int) (sizeof(anim_names) / sizeof(anim_names[0])); a++) {
+    for (int fast = 1; fast >= 0; fast--) {
+      lights_configure((anim) a, fast, COLOR_BLUE, COLOR_WHITE);
+      // The quickest of several batches, since the host has other work
+      double best = 0;
+      for (int batch = 0; batch < BATCHES; batch++) {
+        double start = now_seconds();
+        for (unsigned long f = 0; f < frames / BATCHES; f++) {
+          host_clock_advance_us(20000);
+          lights_loop();
+        }
+        double spent = now_seconds() - start;
+        if (batch == 0 || spent < best) {
+          best = spent;
+        }
+      }
+      printf("%-9s %s %9.0f\n", anim_names[a], fast ? "fast" : "slow", best * 1e9 / (frames / BATCHES));
+    }
+  }
+  return 0;
+}
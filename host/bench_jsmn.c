@@ -0,0 +1,110 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * jsmn throughput with word-at-a-time scanning and without it
+ * (JSMN_NO_SWAR), on the bodies of corpus responses.  Each body is parsed
+ * over and over for a while each way, into a token array as big as it
+ * needs, and the best run is reported.
+ *
+ *   bench_jsmn corpus/geocode.http corpus/alerts-outbreak.http
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../jsmn.h"
+#include "corpus.h"
+
+void jsmn_init_scalar(jsmn_parser *parser);
+int jsmn_parse_scalar(jsmn_parser *parser, const char *js, size_t len,
+                      jsmntok_t *tokens, unsigned int num_tokens);
+
+typedef void (*init_fn)(jsmn_parser *parser);
+typedef int (*parse_fn)(jsmn_parser *parser, const char *js, size_t len,
+                        jsmntok_t *tokens, unsigned int num_tokens);
+
+// How long to keep parsing each way, and in how many rounds
+#define BENCH_SECONDS 0.5
+#define BENCH_ROUNDS 5
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the best bytes per second of several rounds
+static double bench(init_fn init, parse_fn parse, const char *body, size_t len, jsmntok_t *tokens, int count) {
+  double best = 0;
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    unsigned long runs = 0;
+    double start = now_seconds();
+    double elapsed;
+    do {
+      jsmn_parser parser;
+      init(&parser);
+      if (parse(&parser, body, len, tokens, count) != count) {
+        printf("%d tokens expected\n", count);
+        exit(1);
+      }
+      runs++;
+      elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_SECONDS / BENCH_ROUNDS);
+    double rate = runs * len / elapsed;
+    if (rate > best) {
+      best = rate;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  printf("%-32s %9s %7s %12s %12s %7s\n", "body", "bytes", "tokens", "swar MB/s", "scalar MB/s", "speedup");
+  for (int i = 1; i < argc; i++) {
+    size_t len;
+    char *response = corpus_load(argv[i], &len);
+    size_t body_len;
+    const char *body = corpus_body(response, len, &body_len);
+    if (body == NULL) {
+      printf("%s: no identity body\n", argv[i]);
+      return 1;
+    }
+
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    int count = jsmn_parse(&parser, body, body_len, NULL, 0);
+    if (count <= 0) {
+      printf("%s: parse failed: %d\n", argv[i], count);
+      return 1;
+    }
+    jsmntok_t *tokens = (jsmntok_t *) malloc(count * sizeof(jsmntok_t));
+
+    double swar = bench(jsmn_init, jsmn_parse, body, body_len, tokens, count);
+    double scalar = bench(jsmn_init_scalar, jsmn_parse_scalar, body, body_len, tokens, count);
+    const char *name = strrchr(argv[i], '/') != NULL ? strrchr(argv[i], '/') + 1 : argv[i];
+    printf("%-32s %9zu %7d %12.1f %12.1f %6.2fx\n", name, body_len, count, swar / 1e6, scalar / 1e6, swar / scalar);
+
+    free(tokens);
+    free(response);
+  }
+  return 0;
+}
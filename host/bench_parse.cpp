@@ -0,0 +1,174 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays geocoder and alerts responses through the sketch's own requests,
+ * resolve_location_to_lat_lon() and get_active_alert(), with the network
+ * handing over the response in reads of each split size.  For each it
+ * reports the host's throughput over the whole response, the deepest the
+ * request took the stack, the jsmn tokens the geocode body needs of the
+ * ones it's given, and what the request found.  Built with PROFILE
+ * defined, for the stack measurement.
+ *
+ *   bench_parse [-s split,...] response...
+ *
+ * Responses whose names start with "geocode" are geocoder answers; the
+ * rest are alerts.  A split of 0 hands over everything in one read.
+ */
+
+#include <time.h>
+
+#include "../weather.cpp"
+#include "corpus.h"
+
+// Where the lamp is, as poll_weather() gets it from the geocoder
+static const char *lat = "35.994030";
+static const char *lon = "-78.90386";
+
+// How many tokens parse_geocode_response() has room for
+#define GEOCODE_TOKENS 500
+
+static const char *cat_names[] = {
+  "UNKNOWN", "AIR_QUALITY", "COLD", "HEAT", "FLOOD", "LOW_WATER", "MARINE", "SNOW", "WIND", "DUST", "FOG",
+  "FREEZE", "FIRE", "STORM", "ICE", "TORNADO",
+};
+
+static const char *sig_names[] = {
+  "UNKNOWN", "SYNOPSIS", "OUTLOOK", "FORECAST", "STATEMENT", "ADVISTORY", "WATCH", "WARNING",
+};
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs one request over the response; fills in what it found
+static bool run_request(bool geocode, char *result, size_t result_size) {
+  if (geocode) {
+    char found_lat[10];
+    char found_lon[10];
+    if (!resolve_location_to_lat_lon(NWS_LOCATION, found_lat, sizeof(found_lat), found_lon, sizeof(found_lon))) {
+      return false;
+    }
+    snprintf(result, result_size, "%s, %s", found_lat, found_lon);
+  } else {
+    phen_cat cat = CAT_UNKNOWN;
+    phen_sig sig = SIG_UNKNOWN;
+    if (!get_active_alert(lat, lon, &cat, &sig)) {
+      return false;
+    }
+    snprintf(result, result_size, "%s %s", cat_names[cat], sig_names[sig]);
+  }
+  return true;
+}
+
+// Counts the jsmn tokens in the body of a geocode response, decoded the
+// way the sketch reads it
+static int count_geocode_tokens(const char *response, size_t len) {
+  char buf[2048];
+  get_full_body_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.buf = buf;
+  ctx.size = sizeof(buf);
+
+  host_net_serve(response, len, 0, false);
+  http_request req;
+  http_request_init(&req);
+  req.host = "geocode.arcgis.com";
+  req.path_and_query = "/";
+  req.body_cb = get_full_body_cb;
+  req.caller_ctx = &ctx;
+  http_get(&req);
+
+  jsmn_parser parser;
+  jsmn_init(&parser);
+  return jsmn_parse(&parser, buf, ctx.pos, NULL, 0);
+}
+
+static void bench(const char *path, const size_t *splits, int split_count) {
+  size_t len;
+  char *response = corpus_load(path, &len);
+  const char *name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+  bool geocode = strncmp(name, "geocode", 7) == 0;
+
+  char tokens[16] = "-";
+  if (geocode) {
+    snprintf(tokens, sizeof(tokens), "%d/%d", count_geocode_tokens(response, len), GEOCODE_TOKENS);
+  }
+
+  for (int s = 0; s < split_count; s++) {
+    profile_clear();
+    char result[48] = "request failed";
+    phase p = geocode ? PHASE_GEOCODE : PHASE_ALERTS;
+
+    // The second run measures the stack, since the first also pays for
+    // the host resolving library calls, and the rest just the time.  Runs
+    // repeat until there's enough time to measure.
+    int runs = 0;
+    double start = now_seconds();
+    double elapsed;
+    do {
+      host_net_serve(response, len, splits[s], false);
+      if (runs == 1) {
+        profile_stack_begin();
+      }
+      bool ok = run_request(geocode, result, sizeof(result));
+      if (runs == 1) {
+        profile_stack_end(p);
+      }
+      if (!ok) {
+        snprintf(result, sizeof(result), "request failed");
+      }
+      runs++;
+      elapsed = now_seconds() - start;
+    } while (runs < 2 || elapsed < 0.25);
+
+    char split[16];
+    snprintf(split, sizeof(split), splits[s] == 0 ? "all" : "%zu", splits[s]);
+    printf("%-32s %6s %9.2f MB/s %7lu %9s  %s\n", name, split, len * runs / elapsed / 1e6,
+           profile_stack_depth(p), tokens, result);
+  }
+  free(response);
+}
+
+int main(int argc, char **argv) {
+  size_t splits[16] = {1, 7, 64, 1460, 0};
+  int split_count = 5;
+
+  int i = 1;
+  if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+    split_count = 0;
+    for (char *s = strtok(argv[i + 1], ","); s != NULL && split_count < 16; s = strtok(NULL, ",")) {
+      splits[split_count++] = strtoul(s, NULL, 10);
+    }
+    i += 2;
+  }
+  if (i == argc) {
+    printf("usage: bench_parse [-s split,...] response...\n");
+    return 2;
+  }
+
+  profile_setup();
+  printf("%-32s %6s %14s %7s %9s  %s\n", "response", "split", "throughput", "stack", "tokens", "found");
+  for (; i < argc; i++) {
+    bench(argv[i], splits, split_count);
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Builds bench_frames against lights.cpp, lights.h and config.h as they
+# were at each revision given, and runs it.  Only works for revisions from
+# before the scheduler, whose lights_loop() takes no arguments.
+#
+#   ./bench_revisions.sh [-n frames] revision...
+#
+# For example, the float colors against the Q8.8 ones that replaced them:
+#
+#   q88=$(git rev-parse ':/Use Q8.8 fixed-point')
+#   ./bench_revisions.sh $q88^ $q88
+
+set -e
+cd "$(dirname "$0")"
+
+frames=100000
+if [ "$1" = "-n" ]; then
+  frames=$2
+  shift 2
+fi
+
+for rev in "$@"; do
+  dir=build/rev/$(git rev-parse --short "$rev")
+  mkdir -p "$dir"
+  for f in lights.cpp lights.h config.h; do
+    git show "$rev:$f" > "$dir/$f"
+  done
+  ${CXX:-g++} -std=gnu++11 -O2 -w -Istubs -I"$dir" bench_frames.cpp "$dir/lights.cpp" stubs/arduino.cpp \
+    -o "$dir/bench_frames"
+  echo "$rev: $(git log -1 --format=%s "$rev")"
+  "$dir/bench_frames" "$frames"
+done
@@ -0,0 +1,66 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CHECK_H_
+#define __CHECK_H_
+
+/*
+ * What every host test keeps: how many checks it made and how many
+ * failed.  check() counts one and says what it was if it failed, and
+ * check_summary() prints the totals and gives the program's exit status.
+ * Each test program includes this once.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Only the first failures are described, so one bug doesn't bury the rest
+#define CHECK_MAX_PRINTED 20
+
+static unsigned long checks = 0;
+static unsigned long failures = 0;
+
+// Counts a check.  If it failed, prints FAIL and the rest formatted like
+// printf.  Returns ok, so a test can go on to say more about a failure.
+static inline bool check(bool ok, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static inline bool check(bool ok, const char *format, ...) {
+  checks++;
+  if (ok) {
+    return true;
+  }
+  if (failures++ < CHECK_MAX_PRINTED) {
+    va_list args;
+    va_start(args, format);
+    printf("FAIL ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+  }
+  return false;
+}
+
+// Prints the totals; returns what main() should
+static inline int check_summary(void) {
+  printf("%lu checks, %lu failures\n", checks, failures);
+  return failures == 0 ? 0 : 1;
+}
+
+#endif /* __CHECK_H_ */
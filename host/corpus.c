@@ -0,0 +1,63 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "corpus.h"
+
+char *corpus_load(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    exit(2);
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  char *buf = (char *) malloc(size + 1);
+  if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+    perror(path);
+    exit(2);
+  }
+  fclose(f);
+  buf[size] = '\0';
+  *len = size;
+  return buf;
+}
+
+const char *corpus_body(const char *response, size_t len, size_t *body_len) {
+  const char *end = strstr(response, "\r\n\r\n");
+  if (end == NULL) {
+    return NULL;
+  }
+  // Header names are case-insensitive
+  for (const char *line = response; line < end; line = strstr(line, "\r\n") + 2) {
+    const char *chunked = strstr(line, "chunked");
+    if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && chunked != NULL && chunked < strstr(line, "\r\n")) {
+      return NULL;
+    }
+  }
+  const char *body = end + 4;
+  *body_len = len - (body - response);
+  return body;
+}
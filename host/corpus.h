@@ -0,0 +1,46 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CORPUS_H_
+#define __CORPUS_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The files in corpus/ are whole HTTP responses, status line and headers
+ * included, the way they come off the socket.
+ */
+
+// Reads a whole file into a terminated buffer the caller frees.  Exits the
+// program if it can't.
+char *corpus_load(const char *path, size_t *len);
+
+// Finds the body of a response whose body isn't chunked.  Returns NULL if
+// the head never ends or the body is chunked.
+const char *corpus_body(const char *response, size_t len, size_t *body_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CORPUS_H_ */
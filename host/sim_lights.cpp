@@ -0,0 +1,206 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the lights on the virtual clock, each animation fast and slow in
+ * turn, the way the scheduler would: a frame whenever lights_loop() says
+ * the next one is due.  For each it reports the host's wall time per frame
+ * drawn and what each frame did: LEDs composited, LEDs whose output
+ * changed, and strips shown.  Built with LIGHTS_BENCHMARK_SECONDS defined,
+ * for those counts.
+ *
+ *   sim_lights [-t seconds] [-d dir] [-raw] [animation...]
+ *
+ * -t sets how much virtual time each animation runs for after settling.
+ * -d writes what the strip showed to dir/<animation>-<fast|slow>.ppm, one
+ * row of LEDs for every 1/LIGHTS_FRAME_RATE of a second, top to bottom, so
+ * time runs down the image.  -raw writes the same rows as bare RGB bytes
+ * to .rgb files instead.  Animations are named as in the anim enum, in
+ * lower case without the ANIM_; all of them by default.
+ */
+
+#include <time.h>
+
+#include "../lights.cpp"
+
+// How long each animation runs before it's measured, so the fade from the
+// one before it doesn't count
+#define SETTLE_MS 5000
+
+static const char *anim_names[] = {
+  "default", "precip", "flood", "pulse", "swirl", "forecast", "chase", "drift",
+};
+
+// A wet afternoon, for ANIM_FORECAST
+static const forecast_hour sample_forecast[] = {
+  {72, 0, COLOR_BLACK}, {73, 0, COLOR_BLACK}, {73, 2, COLOR_BLACK}, {73, 5, COLOR_BLACK},
+  {72, 15, COLOR_BLUE}, {70, 24, COLOR_BLUE}, {68, 40, COLOR_YELLOW}, {65, 55, COLOR_YELLOW},
+  {62, 70, COLOR_YELLOW}, {58, 62, COLOR_BLUE}, {56, 35, COLOR_BLACK}, {53, 20, COLOR_BLACK},
+};
+
+/*
+   Reads what the strips hold back into LED order, undoing each strip's
+   color order and direction the way led_strip lays them out.
+*/
+template<uint16_t FIRST, typename... S> struct strip_reader {
+  static void read(uint8_t *out) {}
+};
+
+template<uint16_t FIRST, typename S, typename... Rest> struct strip_reader<FIRST, S, Rest...> {
+  static void read(uint8_t *out) {
+    const uint8_t *pixels = S::strip.getPixels();
+    for (int j = 0; j < S::count; j++) {
+      int led = S::reversed ? FIRST + S::count - 1 - j : FIRST + j;
+      out[led * 3] = pixels[j * 3 + S::r_offset];
+      out[led * 3 + 1] = pixels[j * 3 + S::g_offset];
+      out[led * 3 + 2] = pixels[j * 3 + S::b_offset];
+    }
+    strip_reader<FIRST + S::count, Rest...>::read(out);
+  }
+};
+
+typedef strip_reader<0, LED_STRIPS> shown_leds;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+  unsigned long seconds;
+  const char *dump_dir;
+  bool raw;
+} sim_options;
+
+// When lights_loop() next wants to run
+static unsigned long frame_due = 0;
+
+// Runs the lights until the virtual clock reaches until, calling
+// lights_loop() when it asks to be.  Rows of what the strip shows are
+// added to rows, if it's given.  Returns the wall time spent in
+// lights_loop().
+static double run_until(unsigned long until, std::string *rows) {
+  const unsigned long row_ms = 1000 / LIGHTS_FRAME_RATE;
+  unsigned long now = sched_now();
+  unsigned long next_row = now;
+  double spent = 0;
+
+  while (!time_reached(now, until)) {
+    if (time_reached(now, frame_due)) {
+      double start = now_seconds();
+      unsigned long wait = lights_loop(now);
+      spent += now_seconds() - start;
+      frame_due = now + max(wait, 1UL);
+    }
+    if (rows != NULL && time_reached(now, next_row)) {
+      uint8_t row[LED_COUNT * 3];
+      shown_leds::read(row);
+      rows->append((const char *) row, sizeof(row));
+      next_row += row_ms;
+    }
+
+    // On to whichever comes first: the next frame, the next row, or the end
+    unsigned long step = min(until - now, frame_due - now);
+    if (rows != NULL) {
+      step = min(step, next_row - now);
+    }
+    host_clock_advance_us(step * 1000);
+    now = sched_now();
+  }
+  return spent;
+}
+
+static void write_dump(const sim_options *opts, anim animation, const char *mode, const std::string &rows) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s-%s.%s", opts->dump_dir, anim_names[animation], mode,
+           opts->raw ? "rgb" : "ppm");
+  FILE *f = fopen(path, "wb");
+  if (f == NULL) {
+    perror(path);
+    exit(2);
+  }
+  if (!opts->raw) {
+    fprintf(f, "P6\n%d %zu\n255\n", LED_COUNT, rows.size() / (LED_COUNT * 3));
+  }
+  fwrite(rows.data(), 1, rows.size(), f);
+  fclose(f);
+}
+
+static void simulate(anim animation, bool fast, const sim_options *opts) {
+  const char *mode = fast ? "fast" : "slow";
+  lights_configure(animation, fast, COLOR_BLUE, COLOR_WHITE);
+  // As sched_wake() would
+  frame_due = sched_now();
+  run_until(sched_now() + SETTLE_MS, NULL);
+
+  memset(&costs, 0, sizeof(costs));
+  std::string rows;
+  double spent = run_until(sched_now() + opts->seconds * 1000, opts->dump_dir != NULL ? &rows : NULL);
+  if (opts->dump_dir != NULL) {
+    write_dump(opts, animation, mode, rows);
+  }
+
+  unsigned long frames = max((unsigned long) costs.frames, 1UL);
+  printf("%-9s %s %7lu %9.0f %9.1f %9.1f %7.3f\n", anim_names[animation], mode, (unsigned long) costs.frames,
+         spent * 1e9 / frames, (double) costs.leds_blended / frames, (double) costs.leds_written / frames,
+         (double) costs.shows / frames);
+}
+
+int main(int argc, char **argv) {
+  sim_options opts = {300, NULL, false};
+  bool wanted[COUNT_OF(anim_names)] = {false};
+  bool any_wanted = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      opts.seconds = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      opts.dump_dir = argv[++i];
+    } else if (strcmp(argv[i], "-raw") == 0) {
+      opts.raw = true;
+    } else {
+      int a = 0;
+      while (a < COUNT_OF(anim_names) && strcmp(argv[i], anim_names[a]) != 0) {
+        a++;
+      }
+      if (a == COUNT_OF(anim_names)) {
+        printf("usage: sim_lights [-t seconds] [-d dir] [-raw] [animation...]\n");
+        return 2;
+      }
+      wanted[a] = true;
+      any_wanted = true;
+    }
+  }
+
+  lights_setup();
+  lights_set_forecast(sample_forecast, COUNT_OF(sample_forecast));
+
+  printf("%d LEDs, %lu s of each animation\n", LED_COUNT, opts.seconds);
+  printf("%-9s %s %7s %9s %9s %9s %7s\n", "animation", "mode", "frames", "ns/frame", "blended", "written",
+         "shows");
+  for (int a = 0; a < COUNT_OF(anim_names); a++) {
+    if (any_wanted && !wanted[a]) {
+      continue;
+    }
+    simulate((anim) a, true, &opts);
+    simulate((anim) a, false, &opts);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_ADAFRUIT_NEOPIXEL_H_
+#define __HOST_ADAFRUIT_NEOPIXEL_H_
+
+/*
+ * An Adafruit_NeoPixel stand-in that keeps the pixel buffer, in the strip's
+ * own byte order, and counts how often it's shown.
+ */
+
+#include <Arduino.h>
+
+// The library's color order constants: the offsets of white, red, green
+// and blue in each pixel's bytes
+#define NEO_RGB ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+typedef uint16_t neoPixelType;
+
+class Adafruit_NeoPixel {
+ public:
+  Adafruit_NeoPixel(uint16_t n, int16_t pin, neoPixelType type) : num_leds(n), type(type), shows(0) {
+    pixels = (uint8_t *) calloc(n, 3);
+  }
+  ~Adafruit_NeoPixel() { free(pixels); }
+  void begin(void) {}
+  void show(void) { shows++; }
+  bool canShow(void) { return true; }
+  void setBrightness(uint8_t b) {}
+  uint8_t *getPixels(void) const { return pixels; }
+  uint16_t numPixels(void) const { return num_leds; }
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+    if (n < num_leds) {
+      pixels[n * 3 + ((type >> 4) & 3)] = r;
+      pixels[n * 3 + ((type >> 2) & 3)] = g;
+      pixels[n * 3 + (type & 3)] = b;
+    }
+  }
+  void setPixelColor(uint16_t n, uint32_t c) { setPixelColor(n, c >> 16, c >> 8, c); }
+  uint32_t getPixelColor(uint16_t n) const {
+    if (n >= num_leds) {
+      return 0;
+    }
+    const uint8_t *p = pixels + n * 3;
+    return Color(p[(type >> 4) & 3], p[(type >> 2) & 3], p[type & 3]);
+  }
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t) r << 16) | ((uint32_t) g << 8) | b; }
+
+  // Host only: how many times the strip has been shown
+  unsigned long showCount(void) const { return shows; }
+
+ private:
+  uint16_t num_leds;
+  neoPixelType type;
+  uint8_t *pixels;
+  unsigned long shows;
+};
+
+#endif /* __HOST_ADAFRUIT_NEOPIXEL_H_ */
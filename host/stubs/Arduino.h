@@ -0,0 +1,133 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_ARDUINO_H_
+#define __HOST_ARDUINO_H_
+
+/*
+ * Just enough of the Arduino core for the sketch to build and run on a
+ * host.  Time is virtual: it only moves when a test moves it or something
+ * calls delay(), so runs are repeatable and as fast as the host can go.
+ * What the sketch writes to Serial goes to stdout when HOST_SERIAL is set
+ * in the environment.
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define DEC 10
+#define HEX 16
+#define PROGMEM
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+inline void yield(void) {}
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Host only: moves the virtual clock ahead
+void host_clock_advance_us(unsigned long us);
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+class String {
+ public:
+  String(const char *s = "") : s(s) {}
+  String &operator+=(char c) { s += c; return *this; }
+  size_t length() const { return s.size(); }
+  char charAt(size_t i) const { return i < s.size() ? s[i] : 0; }
+  const char *c_str() const { return s.c_str(); }
+ private:
+  std::string s;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      write(buf[i]);
+    }
+    return size;
+  }
+  size_t print(const char *s) { return write((const uint8_t *) s, strlen(s)); }
+  size_t print(const __FlashStringHelper *s) { return print((const char *) s); }
+  size_t print(char c) { return write((uint8_t) c); }
+  size_t print(int n, int base = DEC) { return print((long) n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long) n, base); }
+  size_t print(long n, int base = DEC) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", n);
+    return print(buf);
+  }
+  size_t print(unsigned long n, int base = DEC) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", n);
+    return print(buf);
+  }
+  size_t print(double n, int digits = 2) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+  }
+  template<typename T> size_t println(T v) { return print(v) + println(); }
+  template<typename T> size_t println(T v, int base) { return print(v, base) + println(); }
+  size_t println(void) { return print("\r\n"); }
+  virtual void flush(void) {}
+};
+
+class Serial_ : public Print {
+ public:
+  void begin(unsigned long baud) {}
+  operator bool() { return true; }
+  int available(void);
+  int read(void);
+  int availableForWrite(void) { return 64; }
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buf, size_t size);
+  using Print::write;
+};
+
+extern Serial_ Serial;
+
+// Host only: queues characters for Serial.read()
+void host_serial_input(const char *s);
+// Host only: what's been written to Serial since the last call
+std::string host_serial_output(void);
+
+#endif /* __HOST_ARDUINO_H_ */
@@ -0,0 +1,79 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_WIFI101_H_
+#define __HOST_WIFI101_H_
+
+/*
+ * A WiFi101 stand-in whose connections all answer with whatever response
+ * a test has set up with host_net_serve(), split into reads of at most a
+ * given size, so recorded responses replay through the real HTTP code.
+ */
+
+#include <Arduino.h>
+
+enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL,
+  WL_SCAN_COMPLETED,
+  WL_CONNECTED,
+  WL_CONNECT_FAILED,
+  WL_CONNECTION_LOST,
+  WL_DISCONNECTED,
+  WL_NO_SHIELD = 255,
+};
+
+// Host only: what the next connection answers with, and the most bytes a
+// read hands back at once.  With stall set, every other read finds nothing
+// waiting, like a socket that's ahead of the network.  The response isn't
+// copied, so it has to outlive the request.
+void host_net_serve(const char *response, size_t len, size_t read_size, bool stall);
+// Host only: how much of the response has been read
+size_t host_net_consumed(void);
+
+class WiFiClient : public Print {
+ public:
+  virtual ~WiFiClient() {}
+  int connect(const char *host, uint16_t port);
+  int connectSSL(const char *host, uint16_t port);
+  uint8_t connected(void);
+  int available(void);
+  int read(void);
+  int read(uint8_t *buf, size_t size);
+  void stop(void) {}
+  size_t write(uint8_t c) { return 1; }
+  size_t write(const uint8_t *buf, size_t size) { return size; }
+  using Print::write;
+};
+
+class WiFiSSLClient : public WiFiClient {
+};
+
+class WiFiClass {
+ public:
+  void setPins(int8_t cs, int8_t irq, int8_t rst, int8_t en) {}
+  uint8_t begin(const char *ssid, const char *key) { return WL_CONNECTED; }
+  uint8_t status(void) { return WL_CONNECTED; }
+  void lowPowerMode(void) {}
+  void maxLowPowerMode(void) {}
+};
+
+extern WiFiClass WiFi;
+
+#endif /* __HOST_WIFI101_H_ */
@@ -0,0 +1,183 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+#include <WiFi101.h>
+
+Serial_ Serial;
+WiFiClass WiFi;
+
+// The virtual clock
+static unsigned long clock_us = 0;
+
+unsigned long millis(void) {
+  return clock_us / 1000;
+}
+
+unsigned long micros(void) {
+  return clock_us;
+}
+
+void delay(unsigned long ms) {
+  clock_us += ms * 1000;
+}
+
+void host_clock_advance_us(unsigned long us) {
+  clock_us += us;
+}
+
+// The same generator the SAMD core uses, so sequences match the board's
+long random(long howbig) {
+  if (howbig == 0) {
+    return 0;
+  }
+  return ::random() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) {
+    srandom(seed);
+  }
+}
+
+// Serial
+
+static std::string serial_input;
+
+void host_serial_input(const char *s) {
+  serial_input += s;
+}
+
+int Serial_::available(void) {
+  return serial_input.size();
+}
+
+int Serial_::read(void) {
+  if (serial_input.empty()) {
+    return -1;
+  }
+  int c = (uint8_t) serial_input[0];
+  serial_input.erase(0, 1);
+  return c;
+}
+
+static std::string serial_output;
+
+std::string host_serial_output(void) {
+  std::string output;
+  output.swap(serial_output);
+  return output;
+}
+
+static bool serial_echo(void) {
+  static int echo = -1;
+  if (echo < 0) {
+    echo = getenv("HOST_SERIAL") != NULL;
+  }
+  return echo;
+}
+
+size_t Serial_::write(uint8_t c) {
+  serial_output += (char) c;
+  if (serial_echo()) {
+    putchar(c);
+  }
+  return 1;
+}
+
+size_t Serial_::write(const uint8_t *buf, size_t size) {
+  serial_output.append((const char *) buf, size);
+  if (serial_echo()) {
+    fwrite(buf, 1, size, stdout);
+  }
+  return size;
+}
+
+// The network
+
+static const char *net_response = NULL;
+static size_t net_len = 0;
+static size_t net_pos = 0;
+static size_t net_read_size = 0;
+static bool net_stall = false;
+static bool net_stalled = false;
+
+void host_net_serve(const char *response, size_t len, size_t read_size, bool stall) {
+  net_response = response;
+  net_len = len;
+  net_pos = 0;
+  net_read_size = read_size > 0 ? read_size : len;
+  net_stall = stall;
+  net_stalled = false;
+}
+
+size_t host_net_consumed(void) {
+  return net_pos;
+}
+
+// Whether this read finds nothing waiting
+static bool stalled(void) {
+  if (!net_stall) {
+    return false;
+  }
+  net_stalled = !net_stalled;
+  return net_stalled;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  return net_response != NULL;
+}
+
+int WiFiClient::connectSSL(const char *host, uint16_t port) {
+  return net_response != NULL;
+}
+
+// Like the real client, a closed connection counts as connected until
+// everything it received has been read
+uint8_t WiFiClient::connected(void) {
+  return net_pos < net_len;
+}
+
+int WiFiClient::available(void) {
+  return net_len - net_pos;
+}
+
+int WiFiClient::read(void) {
+  if (net_pos == net_len || stalled()) {
+    return -1;
+  }
+  return (uint8_t) net_response[net_pos++];
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size) {
+  if (net_pos == net_len || stalled()) {
+    return -1;
+  }
+  size_t n = min(size, min(net_read_size, net_len - net_pos));
+  memcpy(buf, net_response + net_pos, n);
+  net_pos += n;
+  return n;
+}
@@ -0,0 +1,139 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays alerts responses through get_active_alert(), identity and
+ * chunked, with many read sizes, and checks the alert it picks.  Also
+ * sends it polygons it can't read, which must count as covering us.
+ *
+ *   test_alerts corpus/alerts-outbreak.http:TORNADO:WARNING ...
+ */
+
+#include "../weather.cpp"
+#include "check.h"
+#include "corpus.h"
+
+// Where the lamp is, as poll_weather() gets it from the geocoder
+static const char *lat = "35.994030";
+static const char *lon = "-78.90386";
+
+static const char *cat_names[] = {
+  "UNKNOWN", "AIR_QUALITY", "COLD", "HEAT", "FLOOD", "LOW_WATER", "MARINE", "SNOW", "WIND", "DUST", "FOG",
+  "FREEZE", "FIRE", "STORM", "ICE", "TORNADO",
+};
+
+static const char *sig_names[] = {
+  "UNKNOWN", "SYNOPSIS", "OUTLOOK", "FORECAST", "STATEMENT", "ADVISTORY", "WATCH", "WARNING",
+};
+
+static int lookup_name(const char *names[], int count, const char *name) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(names[i], name) == 0) {
+      return i;
+    }
+  }
+  printf("unknown name %s\n", name);
+  exit(2);
+}
+
+static void check_result(const char *what, phen_cat cat, phen_sig sig, phen_cat want_cat, phen_sig want_sig) {
+  check(cat == want_cat && sig == want_sig, "%s: got %s %s, want %s %s", what, cat_names[cat], sig_names[sig],
+        cat_names[want_cat], sig_names[want_sig]);
+}
+
+// Replays a corpus response with each read size
+static void check_response(const char *path, phen_cat want_cat, phen_sig want_sig) {
+  size_t len;
+  char *response = corpus_load(path, &len);
+
+  static const size_t read_sizes[] = {1, 3, 64, 1460, 1 << 24};
+  for (size_t r = 0; r < sizeof(read_sizes) / sizeof(read_sizes[0]); r++) {
+    for (int stall = 0; stall < 2; stall++) {
+      host_net_serve(response, len, read_sizes[r], stall);
+      phen_cat cat = CAT_UNKNOWN;
+      phen_sig sig = SIG_UNKNOWN;
+      char what[320];
+      snprintf(what, sizeof(what), "%s (reads of %zu%s)", path, read_sizes[r], stall ? ", stalling" : "");
+      if (!check(get_active_alert(lat, lon, &cat, &sig), "%s: request failed", what)) {
+        continue;
+      }
+      check_result(what, cat, sig, want_cat, want_sig);
+    }
+  }
+  printf("%s: %s %s\n", path, cat_names[want_cat], sig_names[want_sig]);
+  free(response);
+}
+
+// Runs a body through get_active_alert() in one plain response
+static void check_body(const char *what, const std::string &body, phen_cat want_cat, phen_sig want_sig) {
+  std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/geo+json\r\n\r\n" + body;
+  host_net_serve(response.data(), response.size(), response.size(), false);
+  phen_cat cat = CAT_UNKNOWN;
+  phen_sig sig = SIG_UNKNOWN;
+  if (check(get_active_alert(lat, lon, &cat, &sig), "%s: request failed", what)) {
+    check_result(what, cat, sig, want_cat, want_sig);
+  }
+}
+
+static std::string feature(const char *coordinates, const char *vtec) {
+  return std::string("{\"type\": \"Feature\", \"geometry\": {\"type\": \"Polygon\", \"coordinates\": ") +
+         coordinates + "}, \"properties\": {\"parameters\": {\"VTEC\": [\"" + vtec + "\"]}}}";
+}
+
+static void check_bad_polygons(void) {
+  const char *tornado = "/O.NEW.KRAH.TO.W.0031.240410T2111Z-240410T2145Z/";
+  const char *away = "[[[-79.38, 35.58], [-79.19, 35.71], [-79.11, 35.66], [-79.27, 35.52], [-79.38, 35.58]]]";
+  const char *over = "[[[-79.02, 35.93], [-78.84, 36.07], [-78.77, 36.02], [-78.93, 35.89], [-79.02, 35.93]]]";
+
+  std::string head = "{\"type\": \"FeatureCollection\", \"features\": [";
+  check_body("polygon away", head + feature(away, tornado) + "]}", CAT_UNKNOWN, SIG_UNKNOWN);
+  check_body("polygon over", head + feature(over, tornado) + "]}", CAT_TORNADO, SIG_WARNING);
+
+  // Chunk framing left in the body, a position with only one number, and
+  // one with three, all in polygons that are really away from us
+  const char *framed = "[[[-79.38, 35.58], [-79.1\r\n1f40\r\n9, 35.71], [-79.11, 35.66], [-79.38, 35.58]]]";
+  const char *short_pos = "[[[-79.38, 35.58], [-79.19], [-79.11, 35.66], [-79.38, 35.58]]]";
+  const char *long_pos = "[[[-79.38, 35.58], [-79.19, 35.71, 90], [-79.11, 35.66], [-79.38, 35.58]]]";
+  check_body("chunk framing", head + feature(framed, tornado) + "]}", CAT_TORNADO, SIG_WARNING);
+  check_body("short position", head + feature(short_pos, tornado) + "]}", CAT_TORNADO, SIG_WARNING);
+  check_body("long position", head + feature(long_pos, tornado) + "]}", CAT_TORNADO, SIG_WARNING);
+
+  // A bad polygon only counts for its own feature
+  const char *flood = "/O.NEW.KRAH.FF.W.0008.240410T2020Z-240410T2315Z/";
+  check_body("bad then away", head + feature(short_pos, tornado) + ", " + feature(away, flood) + "]}", CAT_TORNADO,
+             SIG_WARNING);
+}
+
+int main(int argc, char **argv) {
+  // Each argument is a response and the alert it should pick
+  for (int i = 1; i < argc; i++) {
+    char path[256];
+    char cat[32];
+    char sig[32];
+    if (sscanf(argv[i], "%255[^:]:%31[^:]:%31s", path, cat, sig) != 3) {
+      printf("usage: test_alerts response:CATEGORY:SIGNIFICANCE...\n");
+      return 2;
+    }
+    check_response(path, (phen_cat) lookup_name(cat_names, sizeof(cat_names) / sizeof(cat_names[0]), cat),
+                   (phen_sig) lookup_name(sig_names, sizeof(sig_names) / sizeof(sig_names[0]), sig));
+  }
+  check_bad_polygons();
+
+  return check_summary();
+}
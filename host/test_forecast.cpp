@@ -0,0 +1,113 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays points and hourly forecast responses through
+ * resolve_forecast_path() and get_hourly_forecast(), identity and chunked,
+ * with many read sizes, and checks the hours they read.
+ *
+ *   test_forecast corpus/points.http corpus/forecast-hourly.http ...
+ */
+
+#include "../weather.cpp"
+#include "check.h"
+#include "corpus.h"
+
+static const size_t read_sizes[] = {1, 3, 64, 1460, 1 << 24};
+
+// The first hours of corpus/forecast-hourly.http
+static const forecast_hour expected[FORECAST_HOURS] = {
+  {72, 0, COLOR_BLACK},
+  {73, 0, COLOR_BLACK},
+  {73, 2, COLOR_BLACK},
+  {73, 5, COLOR_BLACK},
+  {72, 15, COLOR_BLUE},
+  {70, 24, COLOR_BLUE},
+  {68, 40, COLOR_YELLOW},
+  {65, 55, COLOR_YELLOW},
+  {62, 70, COLOR_YELLOW},
+  {58, 62, COLOR_BLUE},
+  {56, 35, COLOR_BLACK},
+  {53, 20, COLOR_BLACK},
+};
+
+static void check_points(const char *path) {
+  size_t len;
+  char *response = corpus_load(path, &len);
+
+  for (size_t r = 0; r < sizeof(read_sizes) / sizeof(read_sizes[0]); r++) {
+    for (int stall = 0; stall < 2; stall++) {
+      host_net_serve(response, len, read_sizes[r], stall);
+      char what[320];
+      snprintf(what, sizeof(what), "%s (reads of %zu%s)", path, read_sizes[r], stall ? ", stalling" : "");
+      char forecast_path[64];
+      if (check(resolve_forecast_path("35.994030", "-78.90386", forecast_path, sizeof(forecast_path)),
+                "%s: request failed", what)) {
+        check(strcmp(forecast_path, "/gridpoints/RAH/62,64/forecast/hourly") == 0, "%s: got %s", what,
+              forecast_path);
+      }
+    }
+  }
+  printf("%s\n", path);
+  free(response);
+}
+
+static void check_forecast(const char *path) {
+  size_t len;
+  char *response = corpus_load(path, &len);
+
+  for (size_t r = 0; r < sizeof(read_sizes) / sizeof(read_sizes[0]); r++) {
+    for (int stall = 0; stall < 2; stall++) {
+      host_net_serve(response, len, read_sizes[r], stall);
+      char what[320];
+      snprintf(what, sizeof(what), "%s (reads of %zu%s)", path, read_sizes[r], stall ? ", stalling" : "");
+      forecast_hour hours[FORECAST_HOURS];
+      uint8_t count = 0;
+      if (!check(get_hourly_forecast("/gridpoints/RAH/62,64/forecast/hourly", hours, &count),
+                 "%s: request failed", what) ||
+          !check(count == FORECAST_HOURS, "%s: %u hours", what, count)) {
+        continue;
+      }
+      for (int i = 0; i < count; i++) {
+        bool same = hours[i].temperature == expected[i].temperature &&
+                    hours[i].precip_chance == expected[i].precip_chance &&
+                    hours[i].precip_color == expected[i].precip_color;
+        if (!check(same, "%s: hour %d is %dF, %u%%, color %d", what, i, hours[i].temperature,
+                   hours[i].precip_chance, hours[i].precip_color)) {
+          break;
+        }
+      }
+    }
+  }
+  printf("%s\n", path);
+  free(response);
+}
+
+int main(int argc, char **argv) {
+  // Points responses are named for it; the rest are hourly forecasts
+  for (int i = 1; i < argc; i++) {
+    if (strstr(argv[i], "points") != NULL) {
+      check_points(argv[i]);
+    } else {
+      check_forecast(argv[i]);
+    }
+  }
+
+  return check_summary();
+}
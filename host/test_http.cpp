@@ -0,0 +1,99 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Reads responses through http_get() and http_read_body(), with every read
+ * size and with reads that find nothing waiting, and checks the body comes
+ * out exactly as sent with chunked transfer encoding taken off.
+ */
+
+#include <WiFi101.h>
+
+#include "check.h"
+#include "http.h"
+
+static void collect_body_cb(http_request *req) {
+  std::string *body = (std::string*) req->caller_ctx;
+  uint8_t buf[64];
+  while (!http_body_done(req)) {
+    int read = http_read_body(req, buf, sizeof(buf));
+    body->append((const char*) buf, read);
+  }
+}
+
+// Gets response with each read size, with and without stalls, and checks
+// the body and how much of the response was read
+static void check_response(const char *what, const std::string &response, const std::string &expected,
+                           size_t expected_consumed) {
+  static const size_t read_sizes[] = {1, 2, 3, 5, 7, 16, 64, 1460, 1 << 20};
+  for (size_t r = 0; r < sizeof(read_sizes) / sizeof(read_sizes[0]); r++) {
+    for (int stall = 0; stall < 2; stall++) {
+      std::string body;
+      host_net_serve(response.data(), response.size(), read_sizes[r], stall);
+
+      http_request req;
+      http_request_init(&req);
+      req.host = "example.com";
+      req.path_and_query = "/";
+      req.body_cb = collect_body_cb;
+      req.caller_ctx = &body;
+      http_get(&req);
+
+      size_t consumed = host_net_consumed();
+      check(req.status == 200 && body == expected && consumed == expected_consumed,
+            "%s (reads of %zu%s): status %d, body \"%s\", read %zu of %zu", what, read_sizes[r],
+            stall ? ", stalling" : "", req.status, body.c_str(), consumed, response.size());
+    }
+  }
+}
+
+static void check_all(const char *what, const std::string &response, const std::string &expected) {
+  check_response(what, response, expected, response.size());
+}
+
+int main(int argc, char **argv) {
+  const std::string ok = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n";
+  const std::string chunked = ok + "Transfer-Encoding: chunked\r\n\r\n";
+
+  check_all("identity", ok + "Content-Length: 9\r\n\r\nWikipedia", "Wikipedia");
+  check_all("HTTP/1.0", "HTTP/1.0 200 OK\r\n\r\n{\"a\": [1, 2]}", "{\"a\": [1, 2]}");
+  check_all("chunked", chunked + "4\r\nWiki\r\n5\r\npedia\r\n0\r\n\r\n", "Wikipedia");
+  check_all("header case", ok + "transfer-encoding: chunked\r\n\r\n4\r\nWiki\r\n0\r\n\r\n", "Wiki");
+  check_all("upper case hex", chunked + "A\r\n0123456789\r\n1B\r\nabcdefghijklmnopqrstuvwxyz!\r\n0\r\n\r\n",
+            "0123456789abcdefghijklmnopqrstuvwxyz!");
+  check_all("leading zeros", chunked + "0004\r\nWiki\r\n000\r\n\r\n", "Wiki");
+  check_all("extensions", chunked + "4;name=value\r\nWiki\r\n5 ; x\r\npedia\r\n0;last\r\n\r\n", "Wikipedia");
+  check_all("bare LF", chunked + "4\nWiki\n5\npedia\n0\n\n", "Wikipedia");
+  check_all("CRLF in data", chunked + "6\r\n\r\n1f\r\n\r\n3\r\n40\n\r\n0\r\n\r\n", "\r\n1f\r\n40\n");
+  check_all("empty", chunked + "0\r\n\r\n", "");
+
+  // Reading stops at the end of the body, whatever follows
+  std::string trailers = chunked + "4\r\nWiki\r\n0\r\nExpires: never\r\nX-Other: 1\r\n\r\n";
+  check_response("trailers", trailers + "HTTP/1.1 200 OK\r\n", "Wiki", trailers.size());
+
+  // Malformed and cut off bodies end without reading past the problem
+  std::string malformed = chunked + "4\r\nWiki\r\nz";
+  check_response("malformed size", malformed + "z\r\npedia\r\n0\r\n\r\n", "Wiki", malformed.size());
+  std::string too_big = chunked + "4\r\nWiki\r\n123456789";
+  check_response("too big", too_big + "\r\npedia", "Wiki", too_big.size());
+  check_all("cut off in data", chunked + "4\r\nWiki\r\n50\r\npedia", "Wikipedia");
+  check_all("cut off in size", chunked + "4\r\nWiki\r\n5", "Wiki");
+
+  return check_summary();
+}
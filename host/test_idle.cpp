@@ -0,0 +1,121 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the lights task under the scheduler on a virtual clock that starts
+ * just short of wrapping, the way the sketch's loop() does, and checks how
+ * much of the time it sleeps: most of it for animations that change
+ * rarely, some of it even for busy ones, and all of it with every layer
+ * off.  Each task run costs a millisecond of virtual time.
+ */
+
+#include "../lights.cpp"
+#include "check.h"
+#include "log.h"
+
+// The virtual clock, and what the scheduler's sleeps on it came to
+static unsigned long vclock = ULONG_MAX - 30000;
+static unsigned long run_end;
+static unsigned long slept;
+static unsigned long longest_sleep;
+static unsigned long task_runs;
+
+static unsigned long virtual_now(void) {
+  return vclock;
+}
+
+// Sleeps no further than the end of the run, as if something woke it
+static void virtual_sleep(unsigned long ms) {
+  longest_sleep = max(longest_sleep, ms);
+  ms = min(ms, run_end - vclock);
+  vclock += ms;
+  slept += ms;
+}
+
+// Runs the loop for ms of virtual time; returns the percentage of it slept
+static unsigned long run_for(const char *what, unsigned long ms) {
+  slept = 0;
+  longest_sleep = 0;
+  task_runs = 0;
+  unsigned long start = vclock;
+  run_end = start + ms;
+  // A loop that never sleeps still gets out, and fails below
+  unsigned long spins = 0;
+  while (vclock - start < ms && spins < 10000000) {
+    if (sched_loop()) {
+      task_runs++;
+      vclock += 1;
+    } else if (!log_drain()) {
+      sched_idle();
+    }
+    spins++;
+  }
+  unsigned long percent = slept * 100 / max(vclock - start, 1UL);
+  printf("%-16s %3lu s: %6lu task runs, slept %3lu%%, longest sleep %lu ms\n", what, ms / 1000, task_runs,
+         percent, longest_sleep);
+  return percent;
+}
+
+int main(int argc, char **argv) {
+  lights_setup();
+  sched_set_clock(virtual_now, virtual_sleep);
+
+  // The default animation changes once in a long while
+  check(run_for("default", 120000) >= 95, "default sleeps");
+  check(longest_sleep >= 1000, "default sleeps long");
+
+  forecast_hour dry[12];
+  for (int i = 0; i < COUNT_OF(dry); i++) {
+    dry[i].temperature = 40 + i * 3;
+    dry[i].precip_chance = 0;
+    dry[i].precip_color = COLOR_BLACK;
+  }
+  lights_set_forecast(dry, COUNT_OF(dry));
+  lights_configure(ANIM_FORECAST, false, COLOR_BLACK, COLOR_BLACK);
+  check(run_for("forecast dry", 60000) >= 95, "dry forecast sleeps");
+
+  // Busy animations still sleep between frames
+  lights_configure(ANIM_PULSE, false, COLOR_LIGHT_GRAY, COLOR_YELLOW);
+  check(run_for("pulse slow", 60000) >= 50, "slow pulse sleeps");
+  lights_configure(ANIM_PRECIP, true, COLOR_BLACK, COLOR_WHITE);
+  check(run_for("precip fast", 20000) >= 50, "fast precip sleeps");
+
+  lights_configure(ANIM_DEFAULT, false, COLOR_BLACK, COLOR_BLACK);
+  lights_configure_layer(LAYER_OVERLAY, ANIM_SWIRL, true, COLOR_WHITE, COLOR_RED);
+  lights_set_layer_blend(LAYER_OVERLAY, BLEND_ADD, 255);
+  check(run_for("default+swirl", 20000) >= 50, "swirl overlay sleeps");
+  lights_set_layer_blend(LAYER_OVERLAY, BLEND_NORMAL, 0);
+  check(run_for("default again", 60000) >= 95, "default again sleeps");
+
+  // With every layer off the lights have nothing to wait for, which must
+  // not leave them due again right away
+  lights_set_layer_blend(LAYER_BASE, BLEND_NORMAL, 0);
+  run_for("turning off", 10000);
+  check(run_for("all off", 60000) >= 99, "all off sleeps");
+  check(task_runs <= 1, "all off runs the lights at most once");
+  check(longest_sleep > 60000, "all off sleeps past the run");
+  check(sched_idle_ms() > 0, "all off has time to sleep");
+
+  // Turning a layer back on wakes the lights straight away
+  lights_set_layer_blend(LAYER_BASE, BLEND_NORMAL, 255);
+  run_for("base back on", 1000 / LIGHTS_FRAME_RATE);
+  check(task_runs >= 1, "base back on runs the lights");
+
+  return check_summary();
+}
@@ -0,0 +1,156 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Differential test of jsmn's word-at-a-time scanning against the plain
+ * parser built with JSMN_NO_SWAR.  Both must return the same thing, fill
+ * the same tokens and leave the parser in the same state for every input:
+ * the corpus bodies, every prefix of them, too few tokens, and random
+ * inputs heavy in the bytes the fast paths have to stop for, at every
+ * alignment.
+ *
+ *   test_jsmn corpus/geocode.http corpus/alerts-outbreak.http
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../jsmn.h"
+#include "check.h"
+#include "corpus.h"
+
+// The same parser compiled with JSMN_NO_SWAR, under other names
+void jsmn_init_scalar(jsmn_parser *parser);
+int jsmn_parse_scalar(jsmn_parser *parser, const char *js, size_t len,
+                      jsmntok_t *tokens, unsigned int num_tokens);
+
+#define MAX_TOKENS 20000
+#define RANDOM_RUNS 200000
+
+static jsmntok_t swar_tokens[MAX_TOKENS];
+static jsmntok_t scalar_tokens[MAX_TOKENS];
+
+// Parses js both ways and compares everything.  A NULL token array asks
+// for a count, which goes down its own path in the parser.
+static void compare_parsers(const char *what, const char *js, size_t len, unsigned int num_tokens, bool count_only) {
+  jsmn_parser swar;
+  jsmn_parser scalar;
+  jsmn_init(&swar);
+  jsmn_init_scalar(&scalar);
+  memset(swar_tokens, 0xee, sizeof(jsmntok_t) * num_tokens);
+  memset(scalar_tokens, 0xee, sizeof(jsmntok_t) * num_tokens);
+
+  int swar_ret = jsmn_parse(&swar, js, len, count_only ? NULL : swar_tokens, num_tokens);
+  int scalar_ret = jsmn_parse_scalar(&scalar, js, len, count_only ? NULL : scalar_tokens, num_tokens);
+
+  check(swar_ret == scalar_ret && memcmp(&swar, &scalar, sizeof(swar)) == 0 &&
+        memcmp(swar_tokens, scalar_tokens, sizeof(jsmntok_t) * num_tokens) == 0,
+        "%s: len %zu, %u tokens: returned %d vs %d, pos %u vs %u", what, len, num_tokens, swar_ret, scalar_ret,
+        swar.pos, scalar.pos);
+}
+
+static void check_body(const char *name, const char *body, size_t len) {
+  jsmn_parser parser;
+  jsmn_init(&parser);
+  int count = jsmn_parse(&parser, body, len, NULL, 0);
+  printf("%s: %zu bytes, %d tokens\n", name, len, count);
+  if (!check(count > 0 && count <= MAX_TOKENS, "%s: can't test with %d tokens", name, count)) {
+    return;
+  }
+
+  compare_parsers(name, body, len, count, false);
+  compare_parsers(name, body, len, count, true);
+  // Running out of tokens part way
+  for (int n = 0; n < count; n += 1 + n / 8) {
+    compare_parsers(name, body, len, n, false);
+  }
+  // Every prefix, so the body ends inside every string and primitive
+  size_t step = len > 20000 ? 7 : 1;
+  for (size_t n = 0; n < len; n += step) {
+    compare_parsers(name, body, n, count, false);
+  }
+}
+
+// The bytes the scanners decide on, plus enough ordinary ones to make runs
+static const char alphabet[] =
+  "\"\\/:,[]{}  \t\r\n\x01\x1f\x7f\x80\xff" "0-1.eE+tfnul" "abcdefghABCDEFGH";
+
+static size_t random_json(char *buf, size_t size) {
+  size_t len = 0;
+  int depth = 0;
+  while (len < size - 2) {
+    int r = rand() % 100;
+    if (r < 8 && depth < 12) {
+      buf[len++] = rand() % 2 ? '{' : '[';
+      depth++;
+    } else if (r < 14 && depth > 0) {
+      buf[len++] = rand() % 2 ? '}' : ']';
+      depth--;
+    } else if (r < 40) {
+      // A string, mostly ordinary bytes
+      buf[len++] = '"';
+      int n = rand() % 40;
+      for (int i = 0; i < n && len < size - 2; i++) {
+        int k = rand() % 10;
+        buf[len++] = k == 0 ? alphabet[rand() % (sizeof(alphabet) - 1)] : 'a' + rand() % 26;
+      }
+      if (rand() % 8 != 0) {
+        buf[len++] = '"';
+      }
+    } else if (r < 60) {
+      // A primitive
+      int n = 1 + rand() % 24;
+      for (int i = 0; i < n && len < size - 2; i++) {
+        buf[len++] = rand() % 6 == 0 ? alphabet[rand() % (sizeof(alphabet) - 1)] : '0' + rand() % 10;
+      }
+    } else {
+      buf[len++] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+  }
+  return len;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    size_t len;
+    char *response = corpus_load(argv[i], &len);
+    size_t body_len;
+    const char *body = corpus_body(response, len, &body_len);
+    if (!check(body != NULL, "%s: no identity body", argv[i])) {
+      continue;
+    }
+    check_body(argv[i], body, body_len);
+    free(response);
+  }
+
+  // Random inputs at every offset from a word boundary, so the fast paths
+  // start and stop everywhere in a word
+  static char buf[600 + 8];
+  srand(42);
+  for (int run = 0; run < RANDOM_RUNS; run++) {
+    int offset = run % 8;
+    size_t len = random_json(buf + offset, 16 + rand() % 580);
+    compare_parsers("random", buf + offset, len, 64, false);
+    compare_parsers("random", buf + offset, len, 8, false);
+  }
+
+  return check_summary();
+}
@@ -0,0 +1,111 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Logs messages into the ring and drains them out of the stand-in serial
+ * port, and checks what comes out: each format's numbers and strings,
+ * long strings cut short, messages going around the ring many times, and
+ * the count of messages dropped while it was full.
+ */
+
+#include <Arduino.h>
+#include <limits.h>
+
+#include "check.h"
+#include "log.h"
+
+// Drains everything waiting, as loop() would given the time
+static std::string drain(void) {
+  host_serial_output();
+  while (log_drain()) {
+  }
+  return host_serial_output();
+}
+
+template<typename... Args>
+static void check_format(const char *expected, const char *format, Args... args) {
+  log_event(format, args...);
+  std::string out = drain();
+  check(out == std::string(expected) + "\r\n", "\"%s\" gave \"%s\", not \"%s\"", format, out.c_str(), expected);
+}
+
+int main(int argc, char **argv) {
+  check_format("no arguments", "no arguments");
+  check_format("hour 3: 72F", "hour %d: %dF", 3, 72);
+  check_format("-40 4000000000 beef", "%d %u %x", -40, 4000000000UL, 0xbeef);
+  check_format("100% sure", "100%% sure");
+  check_format("http #2: header: Content-Type: text/plain", "http #%d: header: %s: %s", 2, "Content-Type",
+               "text/plain");
+  check_format("missing  and 0", "missing %s and %d");
+
+  // Numbers are 32 bits on the board, however wide long is here
+  check_format("ffffffff", "%x", -1);
+  check_format("ffffffff", "%x", -1L);
+  check_format("-1 4294967295", "%d %u", -1L, ULONG_MAX);
+  check_format("-2147483648 2147483647", "%d %d", INT32_MIN, INT32_MAX);
+
+  // Strings are copied up to LOG_MAX_STRING characters
+  std::string long_string(LOG_MAX_STRING + 20, 'a');
+  log_event("[%s] [%s]", long_string.c_str(), "b");
+  std::string out = drain();
+  std::string expected = "[" + long_string.substr(0, LOG_MAX_STRING) + "] [b]\r\n";
+  check(out == expected, "long string gave \"%s\"", out.c_str());
+
+  // Enough messages to go around the ring, and its 16-bit indexes, many
+  // times, some drained as they come and some in batches
+  for (unsigned int i = 0; i < 20000; i++) {
+    log_event("message %u of %s", i, "many");
+    if (i % 7 == 0) {
+      continue;
+    }
+    std::string got = drain();
+    std::string want;
+    for (unsigned int j = i % 7 == 1 ? i - 1 : i; j <= i; j++) {
+      want += "message " + std::to_string(j) + " of many\r\n";
+    }
+    if (!check(got == want, "around the ring: \"%s\" instead of \"%s\"", got.c_str(), want.c_str())) {
+      break;
+    }
+  }
+
+  drain();
+
+  // Fill the ring without draining it.  Each message is a length byte, the
+  // format pointer and one number.
+  const unsigned int fits = LOG_BUFFER_SIZE / (1 + sizeof(const char*) + sizeof(uint32_t));
+  const unsigned int sent = fits + 100;
+  for (unsigned int i = 0; i < sent; i++) {
+    log_event("kept %u", i);
+  }
+  out = drain();
+  expected = "";
+  for (unsigned int i = 0; i < fits; i++) {
+    expected += "kept " + std::to_string(i) + "\r\n";
+  }
+  expected += "log: dropped " + std::to_string(sent - fits) + " messages\r\n";
+  check(out == expected, "full ring gave %zu bytes, not %zu:\n%s", out.size(), expected.size(), out.c_str());
+
+  // The count starts over once it's been reported
+  log_event("after");
+  out = drain();
+  check(out == "after\r\n", "after the drop report: \"%s\"", out.c_str());
+  check(!log_drain(), "nothing left to drain");
+
+  return check_summary();
+}
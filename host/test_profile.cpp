@@ -0,0 +1,120 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs the profiler's host build: stack depths of phases that use known
+ * amounts of stack, which light frames get measured, and the 'p', 'm' and
+ * 'r' commands over the serial port.  Built with PROFILE defined.
+ */
+
+#include <Arduino.h>
+
+#include "check.h"
+#include "lights.h"
+#include "profile.h"
+#include "sched.h"
+
+// Uses bytes of stack, and a little more for the frame itself
+static uint8_t __attribute__((noinline)) use_stack(size_t bytes) {
+  volatile uint8_t room[bytes];
+  for (size_t i = 0; i < bytes; i++) {
+    room[i] = (uint8_t) i;
+  }
+  return room[0];
+}
+
+static void check_depth(const char *what, phase p, size_t bytes) {
+  profile_stack_begin();
+  use_stack(bytes);
+  profile_stack_end(p);
+  unsigned long depth = profile_stack_depth(p);
+  printf("%s: %zu bytes used, %lu measured\n", what, bytes, depth);
+  // Allow for the frames of use_stack() and what called it
+  check(depth >= bytes && depth < bytes + 512, "%s measured %lu bytes for %zu", what, depth, bytes);
+}
+
+// Runs the tasks on the virtual clock until it's gone ms ahead
+static void run_for(unsigned long ms) {
+  unsigned long until = millis() + ms;
+  while (!time_reached(millis(), until)) {
+    if (!sched_loop()) {
+      sched_idle();
+    }
+  }
+}
+
+static std::string command(const char *c) {
+  host_serial_output();
+  host_serial_input(c);
+  run_for(200);
+  return host_serial_output();
+}
+
+int main(int argc, char **argv) {
+  sched_set_clock(millis, delay);
+  profile_setup();
+  lights_setup();
+
+  // Each phase only counts what it used itself, however deep the one
+  // before it went
+  check_depth("alerts", PHASE_ALERTS, 6000);
+  check_depth("geocode", PHASE_GEOCODE, 1000);
+  check_depth("forecast", PHASE_FORECAST, 20000);
+
+  // The first frame is measured, then one in every PROFILE_FRAME_STACK_EVERY
+  int due = 0;
+  int first = -1;
+  int second = -1;
+  for (int frame = 0; frame < PROFILE_FRAME_STACK_EVERY * 4; frame++) {
+    if (profile_frame_stack_due()) {
+      due++;
+      if (first < 0) {
+        first = frame;
+      } else if (second < 0) {
+        second = frame;
+      }
+    }
+  }
+  check(first == 0, "first frame measured, not frame %d", first);
+  check(due == 4 && second == PROFILE_FRAME_STACK_EVERY,
+        "one frame in every PROFILE_FRAME_STACK_EVERY measured, not %d frames with the second at %d", due, second);
+
+  // Draw frames for a while, then ask for everything
+  command("r");
+  run_for(10000);
+  unsigned long frame_depth = profile_stack_depth(PHASE_FRAME);
+  printf("frame: %lu bytes measured\n", frame_depth);
+  check(frame_depth > 0 && frame_depth < 8192, "frame measured");
+
+  std::string profile = command("p");
+  check(profile.find("profile: loop n ") != std::string::npos &&
+            profile.find("profile: animate n ") != std::string::npos,
+        "p prints probes");
+  std::string memory = command("m");
+  check(memory.find("memory: stack peak ") != std::string::npos && memory.find(" frame ") != std::string::npos,
+        "m prints the stack");
+  check(memory.find("memory: heap used ") != std::string::npos, "m prints the heap");
+  printf("%s%s", profile.c_str(), memory.c_str());
+
+  std::string cleared = command("r");
+  check(cleared.find("profile: cleared") != std::string::npos && profile_stack_depth(PHASE_FORECAST) == 0,
+        "r clears");
+
+  return check_summary();
+}
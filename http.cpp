@@ -20,6 +20,9 @@
 #include <WiFi101.h>
 #include "http.h"
 #include "config.h"
+#include "profile.h"
+#include "log.h"
+#include "scratch.h"
 
 static int http_request_id = 0;
 
@@ -191,24 +194,18 @@ void http_request_init(http_request *req) {
 
   req->id = http_request_id++;
   req->status = 0;
+  req->chunked = false;
+  req->chunk_state = HTTP_CHUNK_SIZE_START;
+  req->chunk_left = 0;
 
   req->client = NULL;
 }
 
-#define DBG() print_dbg_prefix(req);
-
-void print_dbg_prefix(http_request  *req) {
-  Serial.print("http #");
-  Serial.print(req->id, DEC);
-  Serial.print(": ");
-}
-
 void http_request_disconnect(http_request  *req) {
   if (req->client != NULL) {
     req->client->stop();
     delete req->client;
-    DBG();
-    Serial.println("disconnected");
+    LOG_DEBUG("http #%d: disconnected", req->id);
   }
   req->client = NULL;
 }
@@ -216,35 +213,182 @@ void http_request_disconnect(http_request  *req) {
 bool http_request_connect(http_request  *req) {
   http_request_disconnect(req);
 
-  DBG();
-  Serial.print("host: ");
-  Serial.println(req->host);
-  DBG();
-  Serial.print("uri: ");
-  Serial.println(req->path_and_query);
+  LOG_DEBUG("http #%d: host: %s", req->id, req->host);
+  LOG_DEBUG("http #%d: uri: %s", req->id, req->path_and_query);
 
   if (req->ssl) {
     req->client = new WiFiSSLClient();
-    DBG();
-    Serial.println("connecting (https)");
+    LOG_DEBUG("http #%d: connecting (https)", req->id);
     return req->client->connectSSL(req->host, req->port);
   } else {
     req->client = new WiFiClient();
-    DBG();
-    Serial.println("connecting (http)");
+    LOG_DEBUG("http #%d: connecting (http)", req->id);
     return req->client->connect(req->host, req->port);
   }
 }
 
+// Reads the status line and headers, calling the header callback for each
+// header.  Returns false if the response was malformed.
+static bool read_response_head(http_request *req) {
+  // Only needed until the body, which may want the scratch space itself
+  scratch_scope scope;
+  char *line = (char*) scratch_alloc(HTTP_LINE_SIZE);
+  if (line == NULL) {
+    req->status = HTTP_STATUS_NO_MEMORY;
+    return false;
+  }
+  size_t read = http_read_line(req->client, line, HTTP_LINE_SIZE);
+
+  // 12 chars is enough for "HTTP/1.1 200"
+  if (read < 12 || (strncmp(line, "HTTP/1.0 ", 9) != 0 && strncmp(line, "HTTP/1.1 ", 9) != 0)) {
+    req->status = HTTP_STATUS_MALFROMED_RESPONSE_LINE;
+    LOG_ERROR("http #%d: malformed response line: %s", req->id, line);
+    return false;
+  }
+
+  req->status = atoi(line + 9);
+
+  // Read headers until we read an empty line
+  do {
+    // Read headers
+    read = http_read_line(req->client, line, HTTP_LINE_SIZE);
+    if (read > 0) {
+      char *header;
+      char *value;
+      if (!parse_header(line, &header, &value)) {
+        // Only a problem if the caller wanted the headers
+        if (req->header_cb == NULL) {
+          continue;
+        }
+        req->status = HTTP_STATUS_MALFROMED_RESPONSE_HEADER;
+        LOG_ERROR("http #%d: malformed response header: %s", req->id, line);
+        return false;
+      }
+      LOG_DEBUG("http #%d: header: %s: %s", req->id, header, value);
+
+      // We send HTTP/1.1, so the body can come in chunks
+      if (strcasecmp(header, "Transfer-Encoding") == 0 && strstr(value, "chunked") != NULL) {
+        req->chunked = true;
+      }
+      if (req->header_cb != NULL) {
+        req->header_cb(req, header, value);
+      }
+    }
+  } while (read > 0);
+  return true;
+}
+
+// Follows one byte of the framing around and between chunks
+static void read_chunk_framing(http_request *req, char c) {
+  int digit = -1;
+  if (c >= '0' && c <= '9') {
+    digit = c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    digit = c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    digit = c - 'A' + 10;
+  }
+
+  switch (req->chunk_state) {
+    case HTTP_CHUNK_SIZE_START:
+    case HTTP_CHUNK_SIZE:
+      if (digit >= 0) {
+        if (req->chunk_left > 0xfffffff) {
+          LOG_ERROR("http #%d: chunk too big", req->id);
+          req->chunk_state = HTTP_CHUNK_DONE;
+          break;
+        }
+        req->chunk_left = req->chunk_left * 16 + digit;
+        req->chunk_state = HTTP_CHUNK_SIZE;
+        break;
+      }
+      if (req->chunk_state == HTTP_CHUNK_SIZE_START) {
+        LOG_ERROR("http #%d: malformed chunk size", req->id);
+        req->chunk_state = HTTP_CHUNK_DONE;
+        break;
+      }
+      // Anything after the size up to the end of the line is extensions,
+      // and the line may end right here
+      req->chunk_state = HTTP_CHUNK_EXTENSION;
+      // fall through
+    case HTTP_CHUNK_EXTENSION:
+      if (c == '\n') {
+        // A chunk of size 0 is the last
+        req->chunk_state = req->chunk_left > 0 ? HTTP_CHUNK_DATA : HTTP_CHUNK_TRAILER;
+      }
+      break;
+    case HTTP_CHUNK_DATA_END:
+      if (c == '\n') {
+        req->chunk_state = HTTP_CHUNK_SIZE_START;
+      }
+      break;
+    case HTTP_CHUNK_TRAILER:
+      if (c == '\n') {
+        if (req->chunk_left == 0) {
+          req->chunk_state = HTTP_CHUNK_DONE;
+        }
+        req->chunk_left = 0;
+      } else if (c != '\r') {
+        req->chunk_left++;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Reads up to size bytes of the response body into buf, taking apart
+// chunked transfer encoding so callers only ever see the body itself.
+// Returns how many bytes were read, which can be 0 if none have arrived.
+int http_read_body(http_request *req, uint8_t *buf, size_t size) {
+  if (!req->chunked) {
+    int read = req->client->read(buf, size);
+    return read > 0 ? read : 0;
+  }
+
+  // The framing is a few bytes between chunks, so it's read a byte at a time
+  while (req->chunk_state != HTTP_CHUNK_DATA) {
+    if (req->chunk_state == HTTP_CHUNK_DONE) {
+      return 0;
+    }
+    int c = req->client->read();
+    if (c == -1) {
+      return 0;
+    }
+    read_chunk_framing(req, c);
+  }
+
+  int read = req->client->read(buf, min(size, req->chunk_left));
+  if (read <= 0) {
+    return 0;
+  }
+  req->chunk_left -= read;
+  if (req->chunk_left == 0) {
+    req->chunk_state = HTTP_CHUNK_DATA_END;
+  }
+  return read;
+}
+
+// True once the whole body has been read, or the connection has closed
+bool http_body_done(http_request *req) {
+  if (req->chunked && req->chunk_state == HTTP_CHUNK_DONE) {
+    return true;
+  }
+  return !req->client->connected();
+}
+
 void http_get(http_request  *req) {
-  DBG();
-  Serial.println("get");
+  LOG_DEBUG("http #%d: get", req->id);
 
-  if (!http_request_connect(req)) {
+  PROFILE_START(connect_start);
+  bool connected = http_request_connect(req);
+  PROFILE_END(PROBE_HTTP_CONNECT, connect_start);
+
+  if (!connected) {
     req->status = HTTP_STATUS_CONNECT_ERR;
-    DBG();
-    Serial.println("connect failed");
+    LOG_ERROR("http #%d: connect failed", req->id);
   } else {
+    PROFILE_START(headers_start);
     req->client->print("GET ");
     req->client->print(req->path_and_query);
     req->client->println(" HTTP/1.1");
@@ -262,54 +406,21 @@ void http_get(http_request  *req) {
 
     req->client->flush();
 
-    char line[1024];
-    size_t read = http_read_line(req->client, line, sizeof(line));
-
-    // 12 chars is enough for "HTTP/1.1 200"
-    if (read < 12 || (strncmp(line, "HTTP/1.0 ", 9) != 0 && strncmp(line, "HTTP/1.1 ", 9) != 0)) {
-      req->status = HTTP_STATUS_MALFROMED_RESPONSE_LINE;
-      DBG();
-      Serial.print("malformed response line: ");
-      Serial.println(line);
+    if (!read_response_head(req)) {
       http_request_disconnect(req);
       return;
     }
-
-    req->status = atoi(line + 9);
-
-    // Read headers until we read an empty line
-    do {
-      // Read headers
-      read = http_read_line(req->client, line, sizeof(line));
-      if (read > 0 && req->header_cb != NULL) {
-        char *header;
-        char *value;
-        if (!parse_header(line, &header, &value)) {
-          req->status = HTTP_STATUS_MALFROMED_RESPONSE_HEADER;
-          DBG();
-          Serial.print("malformed response header: ");
-          Serial.println(line);
-          http_request_disconnect(req);
-          return;
-        }
-        DBG();
-        Serial.print("header: ");
-        Serial.print(header);
-        Serial.print(": ");
-        Serial.println(value);
-        req->header_cb(req, header, value);
-      }
-    } while (read > 0);
+    PROFILE_END(PROBE_HTTP_HEADERS, headers_start);
 
     // Now read the body
     if (req->body_cb != NULL) {
-      DBG();
-      Serial.println("invoking body cb");
+      LOG_DEBUG("http #%d: invoking body cb", req->id);
+      PROFILE_START(body_start);
       req->body_cb(req);
+      PROFILE_END(PROBE_HTTP_BODY, body_start);
     }
 
-    DBG();
-    Serial.println("success");
+    LOG_DEBUG("http #%d: success", req->id);
   }
 
   http_request_disconnect(req);
@@ -25,6 +25,10 @@
 #define HTTP_STATUS_CONNECT_ERR                 -1
 #define HTTP_STATUS_MALFROMED_RESPONSE_LINE     -2
 #define HTTP_STATUS_MALFROMED_RESPONSE_HEADER   -3
+#define HTTP_STATUS_NO_MEMORY                   -4
+
+// Longest status or header line read, including its terminator
+#define HTTP_LINE_SIZE 1024
 
 typedef enum {
   HTTP_METHOD_NEW,
@@ -34,6 +38,23 @@ typedef enum {
   HTTP_METHOD_CLOSED,
 } http_method_state;
 
+// Where http_read_body() is in a chunked body
+typedef enum {
+  // Expecting the first hex digit of a chunk's size
+  HTTP_CHUNK_SIZE_START,
+  // Reading the rest of the size
+  HTTP_CHUNK_SIZE,
+  // Skipping any extensions to the end of the size line
+  HTTP_CHUNK_EXTENSION,
+  // Reading the chunk's data
+  HTTP_CHUNK_DATA,
+  // Skipping the CRLF after the data
+  HTTP_CHUNK_DATA_END,
+  // Skipping trailer headers after the last chunk, up to an empty line
+  HTTP_CHUNK_TRAILER,
+  HTTP_CHUNK_DONE,
+} http_chunk_state;
+
 
 // Predefined for self-reference in callbacks
 typedef struct http_request http_request;
@@ -48,6 +69,7 @@ struct http_request {
 
   void (*header_cb)(http_request *req, const char *header, const char *value);
 
+  // Reads the body with http_read_body() until http_body_done()
   void (*body_cb)(http_request *req);
 
   void *caller_ctx;
@@ -55,6 +77,11 @@ struct http_request {
   // HTTP methods fill these fields
   int id;
   int status;
+  // The body comes in chunks, which http_read_body() takes apart
+  bool chunked;
+  http_chunk_state chunk_state;
+  // Bytes left in the current chunk, or read of the current trailer line
+  unsigned long chunk_left;
 
   // Valid during callback execution
   WiFiClient *client;
@@ -69,5 +96,8 @@ typedef struct {
 
 void http_request_init(http_request *req);
 void http_get(http_request *req);
+int http_read_body(http_request *req, uint8_t *buf, size_t size);
+bool http_body_done(http_request *req);
+bool parse_url(url_parts *parts, const char *url);
 
 #endif /* __HTTP_H */
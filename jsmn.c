@@ -24,6 +24,90 @@
 
 #include "jsmn.h"
 
+#ifndef JSMN_NO_SWAR
+#include <stdint.h>
+
+/*
+ * Word-at-a-time ("SIMD within a register") scanning.  A word is the native
+ * pointer width: 32 bits on the Cortex-M0, 64 bits on most hosts.  The fast
+ * paths below only ever skip bytes the scalar loops would have passed over
+ * without doing anything; as soon as a word contains a byte that needs a
+ * decision, they stop and let the scalar code take over from that byte.
+ * Define JSMN_NO_SWAR to compile the plain byte-at-a-time parser.
+ */
+typedef uintptr_t jsmn_word_t;
+#if defined(__GNUC__)
+typedef uintptr_t __attribute__((__may_alias__)) jsmn_word_alias_t;
+#else
+typedef uintptr_t jsmn_word_alias_t;
+#endif
+
+#define JSMN_WORD_ONES  ((jsmn_word_t) -1 / 0xff)
+#define JSMN_WORD_HIGHS (JSMN_WORD_ONES * 0x80)
+/* Nonzero if any byte of x is less than n (0 <= n <= 128) */
+#define JSMN_WORD_HAS_LESS(x, n) (((x) - JSMN_WORD_ONES * (n)) & ~(x) & JSMN_WORD_HIGHS)
+/* Nonzero if any byte of x is greater than n (0 <= n <= 127) */
+#define JSMN_WORD_HAS_MORE(x, n) ((((x) + JSMN_WORD_ONES * (127 - (n))) | (x)) & JSMN_WORD_HIGHS)
+/* Nonzero if any byte of x equals b */
+#define JSMN_WORD_HAS_BYTE(x, b) JSMN_WORD_HAS_LESS((x) ^ (JSMN_WORD_ONES * (unsigned char) (b)), 1)
+
+#define JSMN_WORD_ALIGNED(p) (((uintptr_t) (p) & (sizeof(jsmn_word_t) - 1)) == 0)
+
+/**
+ * Returns the position of the first byte at or after pos that the string
+ * scanner must look at: a quote, a backslash or a NUL terminator.  Returns
+ * a position no greater than len.
+ */
+static size_t jsmn_skip_string_chars(const char *js, size_t pos, size_t len) {
+    /* Bytewise up to a word boundary */
+    for (; pos < len && !JSMN_WORD_ALIGNED(js + pos); pos++) {
+        char c = js[pos];
+        if (c == '\"' || c == '\\' || c == '\0') {
+            return pos;
+        }
+    }
+    /* Then a whole word per iteration */
+    for (; len - pos >= sizeof(jsmn_word_t); pos += sizeof(jsmn_word_t)) {
+        jsmn_word_t w = *(const jsmn_word_alias_t *) (js + pos);
+        if (JSMN_WORD_HAS_LESS(w, 1) | JSMN_WORD_HAS_BYTE(w, '\"') | JSMN_WORD_HAS_BYTE(w, '\\')) {
+            break;
+        }
+    }
+    return pos;
+}
+
+/**
+ * Returns the position of the first byte at or after pos that the primitive
+ * scanner must look at: a delimiter, or a byte outside the printable ASCII
+ * range (which includes whitespace and the NUL terminator).  Returns a
+ * position no greater than len.
+ */
+static size_t jsmn_skip_primitive_chars(const char *js, size_t pos, size_t len) {
+    for (; pos < len && !JSMN_WORD_ALIGNED(js + pos); pos++) {
+        char c = js[pos];
+        if (c <= ' ' || c >= 127 || c == ',' || c == ']' || c == '}'
+#ifndef JSMN_STRICT
+            || c == ':'
+#endif
+                ) {
+            return pos;
+        }
+    }
+    for (; len - pos >= sizeof(jsmn_word_t); pos += sizeof(jsmn_word_t)) {
+        jsmn_word_t w = *(const jsmn_word_alias_t *) (js + pos);
+        if (JSMN_WORD_HAS_LESS(w, ' ' + 1) | JSMN_WORD_HAS_MORE(w, 126) |
+            JSMN_WORD_HAS_BYTE(w, ',') | JSMN_WORD_HAS_BYTE(w, ']') | JSMN_WORD_HAS_BYTE(w, '}')
+#ifndef JSMN_STRICT
+            | JSMN_WORD_HAS_BYTE(w, ':')
+#endif
+                ) {
+            break;
+        }
+    }
+    return pos;
+}
+#endif /* JSMN_NO_SWAR */
+
 /**
  * Allocates a fresh unused token from the token pull.
  */
@@ -63,6 +147,9 @@ static int jsmn_parse_primitive(jsmn_parser *parser, const char *js,
 
     start = parser->pos;
 
+#ifndef JSMN_NO_SWAR
+    parser->pos = jsmn_skip_primitive_chars(js, parser->pos, len);
+#endif
     for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
         switch (js[parser->pos]) {
 #ifndef JSMN_STRICT
@@ -120,7 +207,16 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
 
     /* Skip starting quote */
     for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
-        char c = js[parser->pos];
+        char c;
+
+#ifndef JSMN_NO_SWAR
+        /* Jump over runs of ordinary characters */
+        parser->pos = jsmn_skip_string_chars(js, parser->pos, len);
+        if (parser->pos >= len || js[parser->pos] == '\0') {
+            break;
+        }
+#endif
+        c = js[parser->pos];
 
         /* Quote: end of string */
         if (c == '\"') {
@@ -0,0 +1,133 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500 
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "json_stream.h"
+
+void json_stream_init(json_stream *js) {
+  js->open_cb = NULL;
+  js->close_cb = NULL;
+  js->value_cb = NULL;
+  js->caller_ctx = NULL;
+  js->done = false;
+
+  js->depth = 0;
+  js->state = JSON_STREAM_BETWEEN;
+  js->string_pending = false;
+  js->key[0] = '\0';
+  js->value[0] = '\0';
+  js->value_pos = 0;
+}
+
+static void json_stream_append(json_stream *js, char c) {
+  // Leave room for the terminator
+  if (js->value_pos < sizeof(js->value) - 1) {
+    js->value[js->value_pos++] = c;
+  }
+}
+
+// Reports the value that was just read and forgets the key it belonged to
+static void json_stream_emit_value(json_stream *js) {
+  js->value[js->value_pos] = '\0';
+  if (js->value_cb != NULL) {
+    js->value_cb(js, js->key, js->value);
+  }
+  js->key[0] = '\0';
+  js->value_pos = 0;
+}
+
+void json_stream_feed(json_stream *js, char c) {
+  switch (js->state) {
+    case JSON_STREAM_IN_STRING:
+      if (c == '"') {
+        js->value[js->value_pos] = '\0';
+        js->string_pending = true;
+        js->state = JSON_STREAM_BETWEEN;
+      } else if (c == '\\') {
+        js->state = JSON_STREAM_IN_STRING_ESCAPE;
+      } else {
+        json_stream_append(js, c);
+      }
+      return;
+    case JSON_STREAM_IN_STRING_ESCAPE:
+      // Good enough for "\/" and "\"", which is all we expect to care about
+      json_stream_append(js, c);
+      js->state = JSON_STREAM_IN_STRING;
+      return;
+    case JSON_STREAM_IN_PRIMITIVE:
+      if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        json_stream_emit_value(js);
+        js->state = JSON_STREAM_BETWEEN;
+        // Fall through to handle the delimiter
+        break;
+      }
+      json_stream_append(js, c);
+      return;
+    case JSON_STREAM_BETWEEN:
+      break;
+  }
+
+  if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+    return;
+  }
+
+  // The first thing after a string tells us whether it was a key
+  if (js->string_pending) {
+    js->string_pending = false;
+    if (c == ':') {
+      strncpy(js->key, js->value, sizeof(js->key) - 1);
+      js->key[sizeof(js->key) - 1] = '\0';
+      js->value_pos = 0;
+      return;
+    }
+    json_stream_emit_value(js);
+  }
+
+  switch (c) {
+    case '"':
+      js->value_pos = 0;
+      js->state = JSON_STREAM_IN_STRING;
+      break;
+    case '{':
+    case '[':
+      js->depth++;
+      if (js->open_cb != NULL) {
+        js->open_cb(js, js->key);
+      }
+      js->key[0] = '\0';
+      break;
+    case '}':
+    case ']':
+      if (js->close_cb != NULL) {
+        js->close_cb(js);
+      }
+      js->depth--;
+      js->key[0] = '\0';
+      break;
+    case ',':
+    case ':':
+      break;
+    default:
+      js->value_pos = 0;
+      json_stream_append(js, c);
+      js->state = JSON_STREAM_IN_PRIMITIVE;
+      break;
+  }
+}
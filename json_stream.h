@@ -0,0 +1,73 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500 
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __JSON_STREAM_H_
+#define __JSON_STREAM_H_
+
+#include <stdint.h>
+
+/*
+ * A streaming JSON reader for documents too big to hold in memory.  Feed it
+ * one character at a time and it calls back as containers open and close
+ * and as scalar values complete.  Memory use is fixed: keys and values
+ * longer than the buffers below are truncated, and nothing else is kept.
+ */
+
+typedef enum {
+  JSON_STREAM_BETWEEN,
+  JSON_STREAM_IN_STRING,
+  JSON_STREAM_IN_STRING_ESCAPE,
+  JSON_STREAM_IN_PRIMITIVE,
+} json_stream_state;
+
+// Predefined for self-reference in callbacks
+typedef struct json_stream json_stream;
+
+struct json_stream {
+  // Caller fills these fields.  Any callback may be NULL.  During all
+  // callbacks, depth is the depth of the values inside the container
+  // (values in the top-level object are depth 1).
+
+  // An object or array opened as the value of key ("" in arrays)
+  void (*open_cb)(json_stream *js, const char *key);
+  // An object or array closed
+  void (*close_cb)(json_stream *js);
+  // A string or primitive value was read.  Strings have their quotes
+  // removed; primitives (numbers, true, false, null) are as written.
+  void (*value_cb)(json_stream *js, const char *key, const char *value);
+
+  void *caller_ctx;
+
+  // Callbacks set this when they have what they need
+  bool done;
+
+  // Reader state
+  uint8_t depth;
+  json_stream_state state;
+  // A string ended and we don't know yet if it's a key or a value
+  bool string_pending;
+  char key[32];
+  char value[80];
+  uint8_t value_pos;
+};
+
+void json_stream_init(json_stream *js);
+void json_stream_feed(json_stream *js, char c);
+
+#endif /* __JSON_STREAM_H_ */
@@ -18,300 +18,1124 @@
  */
 
 #include <Adafruit_NeoPixel.h>
-#include <float.h>
+#include <limits.h>
 
 #include "config.h"
 #include "lights.h"
+#include "sched.h"
+#include "profile.h"
+#include "log.h"
 
-// Each channel is 0-1
+// Each channel is Q8.8 fixed point: 0-255 in the high byte, with 8 bits of
+// fraction below so slow fades can take steps smaller than one output level.
+// The M0 has no FPU, so this keeps color math out of the soft-float library.
 typedef struct {
-  float r;
-  float g;
-  float b;
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
 } rgb;
 
 
-// All colors are RGB order in this struct
+// An 8-bit color, used where a color has to be remembered per LED
+typedef struct {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+} rgb8;
+
+// Hue, saturation and value, for fades that go around the color wheel
+// instead of through the grays between colors
+typedef struct {
+  // Sixths of a turn, 256 steps each: 0 is red, 512 green, 1024 blue
+  uint16_t h;
+  uint8_t s;
+  uint8_t v;
+} hsv;
+
+#define HUE_RANGE (6 * 256)
+
+// Color space LEDs fade through on the way from one color to another
+typedef enum {
+  // Each of red, green and blue moves in a straight line
+  FADE_RGB,
+  // Hue takes the short way around the wheel, with saturation and value
+  // moving in straight lines
+  FADE_HSV,
+} fade_space;
+
+// Number of 32-bit words in a bit-per-LED mask
+#define LED_MASK_WORDS ((LED_COUNT + 31) / 32)
+
+// Largest number of segments in any pattern
+#define PATTERN_MAX_SEGMENTS 2
+
+// One layer of the picture: an animation and the LED colors it draws.
+// All colors are RGB order in this struct.
 typedef struct {
   anim animation;
   bool fast;
   color base_color;
   color highlight_color;
 
-  // LED states, RGB color space
-  rgb target_colors[LED_COUNT];
-  rgb current_colors[LED_COUNT];
-  rgb source_colors[LED_COUNT];
-  int fade_in_steps;
-  int fade_out_steps;
-} cloud_state;
+  // How the layer combines with the ones under it.  Layers with an alpha
+  // of 0 are off, and their animations don't run.
+  blend_mode blend;
+  uint8_t alpha;
+
+  // LED states.  Each LED fades from a source color, captured when its
+  // target last changed, to a palette entry.  Colors in between are worked
+  // out from the time since the fade started rather than stored.
+  uint8_t targets[LED_COUNT];
+  rgb8 sources[LED_COUNT];
+  uint16_t fade_starts[LED_COUNT];
+  // How long fades up and down take, and how often to draw frames.
+  // Animations set these to suit themselves.
+  uint16_t fade_in_ms;
+  uint16_t fade_out_ms;
+  fade_space fade_mode;
+  uint16_t frame_rate;
+  // Fade speeds as 2^24 / duration, so a channel's progress through its
+  // fade is a multiply rather than a divide.  Set each frame.
+  uint32_t fade_in_scale;
+  uint32_t fade_out_scale;
 
-// Defines an rgb
-#define RGB_HEX(R,G,B)  ((rgb) { ((R) / 255.0), ((G) / 255.0), ((B) / 255.0) })
+  // LEDs with a fade in progress, one bit each
+  uint32_t fading_leds[LED_MASK_WORDS];
+
+  // How far each segment of the layer's pattern has moved, in LEDs
+  uint8_t pattern_offsets[PATTERN_MAX_SEGMENTS];
+  // Set when the layer's pattern or its colors change
+  bool pattern_redraw;
+  // When the layer's animation last updated its LEDs (for the default
+  // animation, when it next will), and how many steps it has taken, for
+  // animations that move or alternate
+  unsigned long anim_time;
+  uint16_t anim_step;
+  // When the animation will next change anything, for animations that can
+  // say.  Cleared before each frame.
+  unsigned long next_change;
+  bool next_change_known;
+  // LEDs lit by the last precipitation update
+  uint32_t precip_lit[LED_MASK_WORDS];
+} layer_state;
+
+// Defines an rgb from 8-bit channels
+#define RGB_HEX(R,G,B)  { (R) << 8, (G) << 8, (B) << 8 }
 
 #define MIN3(X,Y,Z)  (X < Y ? (X < Z ? X : Z) : (Y < Z ? Y : Z))
 #define MAX3(X,Y,Z)  (X > Y ? (X > Z ? X : Z) : (Y > Z ? Y : Z))
 
-static rgb colors[COLOR_MAX + 1];
-static cloud_state state;
-static byte flood_queue[LED_COUNT];
-static byte swirl_queue[LED_COUNT];
-Adafruit_NeoPixel strip(LED_COUNT, LED_PIN, NEO_GRB + NEO_KHZ800);
+/*
+   Perceived brightness isn't linear in LED duty cycle, so channel levels go
+   through the CIE 1931 lightness curve on the way out.  This builds the
+   256-entry table at compile time; it lives in flash.
+*/
+constexpr float cie_luminance(float lightness) {
+  return lightness <= 8.0f ? lightness / 903.3f
+                           : ((lightness + 16.0f) / 116.0f) * ((lightness + 16.0f) / 116.0f) * ((lightness + 16.0f) / 116.0f);
+}
 
-void lights_setup(void) {
-  strip.begin();
-  strip.show();
-  strip.setBrightness(255);
+constexpr uint8_t gamma_level(unsigned level) {
+  return (uint8_t) (cie_luminance(level * 100.0f / 255.0f) * 255.0f + 0.5f);
+}
 
-  // Initialize the flood queue
-  for (int i = 0; i < LED_COUNT; i++) {
-    flood_queue[i] = 0;
-  }
-  flood_queue[0]  = 1;
-  flood_queue[1]  = 1;
-  flood_queue[2]  = 1;
-  flood_queue[3]  = 1;
-  flood_queue[4]  = 1;
-  flood_queue[5]  = 1;
-  flood_queue[6]  = 1;
-  flood_queue[7]  = 1;
-  flood_queue[8]  = 2;
-  flood_queue[9]  = 2;
-  flood_queue[10] = 2;
-  flood_queue[11] = 2;
-  flood_queue[12] = 2;
-  flood_queue[13] = 2;
-  flood_queue[14] = 2;
-  flood_queue[15] = 2;
-  flood_queue[67] = 1;
-  flood_queue[66] = 1;
-  flood_queue[65] = 1;
-  flood_queue[64] = 1;
-  flood_queue[63] = 1;
-  flood_queue[62] = 1;
-  flood_queue[61] = 1;
-  flood_queue[60] = 1;
-  flood_queue[59] = 2;
-  flood_queue[58] = 2;
-  flood_queue[57] = 2;
-  flood_queue[56] = 2;
-  flood_queue[55] = 2;
-  flood_queue[54] = 2;
-  flood_queue[53] = 2;
-  flood_queue[52] = 2;
-
-  // Initialize the swirl queue
-  for (int i = 0; i < LED_COUNT; i++) {
-    swirl_queue[i] = 0;
-  }
-  swirl_queue[0]  = 1;
-  swirl_queue[1]  = 1;
-  swirl_queue[2]  = 1;
-  swirl_queue[3]  = 1;
-  swirl_queue[4]  = 1;
-  swirl_queue[5]  = 1;
-  swirl_queue[6]  = 1;
-  swirl_queue[7]  = 1;
-  swirl_queue[8]  = 1;
-  swirl_queue[9]  = 2;
-  swirl_queue[10] = 2;
-  swirl_queue[11] = 2;
-  swirl_queue[12] = 2;
-  swirl_queue[13] = 2;
-  swirl_queue[14] = 2;
-  swirl_queue[15] = 2;
-
-  // Initialize our named colors
-  colors[COLOR_BLACK]      = RGB_HEX(0x00, 0x00, 0x00);
-  colors[COLOR_WHITE]      = RGB_HEX(0xff, 0xff, 0xff);
-  colors[COLOR_RED]        = RGB_HEX(0xff, 0x00, 0x00);
-  colors[COLOR_GREEN]      = RGB_HEX(0x00, 0xff, 0x00);
-  colors[COLOR_BLUE]       = RGB_HEX(0x00, 0x00, 0xff);
-  colors[COLOR_LIGHT_BLUE] = RGB_HEX(0xb5, 0xdd, 0xff);
-  colors[COLOR_DARK_BLUE]  = RGB_HEX(0x16, 0x88, 0xfa);
-  colors[COLOR_LIGHT_GRAY] = RGB_HEX(0xaa, 0xaa, 0xaa);
-  colors[COLOR_DARK_GRAY]  = RGB_HEX(0x30, 0x30, 0x30);
-  colors[COLOR_YELLOW]     = RGB_HEX(0xfc, 0xec, 0x5b);
-  colors[COLOR_ORANGE]     = RGB_HEX(0xff, 0x89, 0x00);
+template<unsigned... I> struct index_list {};
+template<unsigned N, unsigned... I> struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+template<unsigned... I> struct make_index_list<0, I...> {
+  typedef index_list<I...> type;
+};
+
+// A table of F::at(i) for i from 0 to N - 1, built at compile time
+template<typename F, unsigned N, typename I = typename make_index_list<N>::type> struct lookup_table;
+template<typename F, unsigned N, unsigned... I> struct lookup_table<F, N, index_list<I...> > {
+  static constexpr typename F::type values[N] = { F::at(I)... };
+};
+template<typename F, unsigned N, unsigned... I>
+constexpr typename F::type lookup_table<F, N, index_list<I...> >::values[N];
+
+struct gamma_curve {
+  typedef uint8_t type;
+  static constexpr uint8_t at(unsigned level) {
+    return gamma_level(level);
+  }
+};
+
+typedef lookup_table<gamma_curve, 256> gamma_levels;
+
+static_assert(gamma_levels::values[0] == 0 && gamma_levels::values[255] == 255, "gamma table must span 0-255");
+
+/*
+   Where each LED is, from the layout in config.h, so animations can move
+   across the cloud's shape instead of along the strip.  x runs from the
+   left end (0) to the right (255) and y from the front (0) to the back
+   (255).  angle is the LED's direction from the middle in 1/256ths of a
+   turn, starting at the front and going the way the LED numbers do.
+*/
+typedef struct {
+  uint8_t x;
+  uint8_t y;
+  uint8_t angle;
+} led_position;
+
+typedef struct {
+  uint8_t first_led;
+  uint8_t led_count;
+  uint8_t first_x;
+  uint8_t last_x;
+  uint8_t y;
+} layout_run;
+
+static constexpr layout_run layout[] = LED_LAYOUT;
+
+#define LAYOUT_RUNS (sizeof(layout) / sizeof(layout[0]))
+
+constexpr bool layout_covers(unsigned r, unsigned next_led) {
+  return r == LAYOUT_RUNS ? next_led == LED_COUNT
+         : layout[r].first_led == next_led && layout_covers(r + 1, next_led + layout[r].led_count);
+}
+
+static_assert(layout_covers(0, 0), "LED_LAYOUT runs must cover the strip in order");
+
+constexpr unsigned layout_run_for(unsigned led, unsigned r) {
+  return led < layout[r].first_led + layout[r].led_count ? r : layout_run_for(led, r + 1);
+}
+
+constexpr float layout_x(unsigned led, const layout_run &run) {
+  return (run.first_x + ((float) run.last_x - run.first_x) * (led - run.first_led) / (run.led_count - 1)) * 255.0f / LED_LAYOUT_WIDTH;
+}
+
+constexpr float layout_y(const layout_run &run) {
+  return run.y * 255.0f / LED_LAYOUT_DEPTH;
+}
+
+constexpr float abs_f(float v) {
+  return v < 0 ? -v : v;
+}
+
+// atan(z) for -1 <= z <= 1, good to about a third of a degree
+constexpr float atan_unit(float z) {
+  return z * (0.7854f + 0.273f * (1.0f - abs_f(z)));
+}
+
+// atan2(y, x), from -pi to pi
+constexpr float atan2_f(float y, float x) {
+  return abs_f(x) >= abs_f(y)
+         ? atan_unit(y / x) + (x >= 0 ? 0.0f : (y >= 0 ? 3.1415927f : -3.1415927f))
+         : (y > 0 ? 1.5707963f : -1.5707963f) - atan_unit(x / y);
+}
+
+// Forward from the middle is toward the front (low y), and a quarter
+// turn from there is toward the right (high x)
+constexpr uint8_t layout_angle(float x, float y) {
+  return (int) (atan2_f(x - 127.5f, 127.5f - y) * 40.743665f + 256.5f) & 255;
+}
+
+struct led_layout {
+  typedef led_position type;
+  static constexpr led_position at(unsigned led) {
+    return led_position {
+      (uint8_t) (layout_x(led, layout[layout_run_for(led, 0)]) + 0.5f),
+      (uint8_t) (layout_y(layout[layout_run_for(led, 0)]) + 0.5f),
+      layout_angle(layout_x(led, layout[layout_run_for(led, 0)]), layout_y(layout[layout_run_for(led, 0)]))
+    };
+  }
+};
+
+typedef lookup_table<led_layout, LED_COUNT> led_positions;
+
+// 3f^2 - 2f^3 for f from 0 to 255/256, in 1/256ths, to ease between
+// lattice points in value_noise()
+struct smoothstep_curve {
+  typedef uint8_t type;
+  static constexpr uint8_t at(unsigned f) {
+    return (f * f * (768UL - 2 * f)) >> 16;
+  }
+};
+
+typedef lookup_table<smoothstep_curve, 256> smoothstep_levels;
+
+// Our named colors, in color enum order
+static constexpr rgb colors[COLOR_MAX + 1] = {
+  RGB_HEX(0x00, 0x00, 0x00), // COLOR_BLACK
+  RGB_HEX(0xff, 0xff, 0xff), // COLOR_WHITE
+  RGB_HEX(0xff, 0x00, 0x00), // COLOR_RED
+  RGB_HEX(0x00, 0xff, 0x00), // COLOR_GREEN
+  RGB_HEX(0x00, 0x00, 0xff), // COLOR_BLUE
+  RGB_HEX(0xb5, 0xdd, 0xff), // COLOR_LIGHT_BLUE
+  RGB_HEX(0x16, 0x88, 0xfa), // COLOR_DARK_BLUE
+  RGB_HEX(0xaa, 0xaa, 0xaa), // COLOR_LIGHT_GRAY
+  RGB_HEX(0x30, 0x30, 0x30), // COLOR_DARK_GRAY
+  RGB_HEX(0xfc, 0xec, 0x5b), // COLOR_YELLOW
+  RGB_HEX(0xff, 0x89, 0x00), // COLOR_ORANGE
+};
+
+// Colors that aren't named (random ones, temperatures) get one of these
+// slots, which follow the named colors in the palette.  A slot is reused
+// once no LED is fading to it.
+#define ADHOC_COLORS 16
+#define PALETTE_SIZE (COLOR_MAX + 1 + ADHOC_COLORS)
+static rgb adhoc_colors[ADHOC_COLORS];
+static layer_state layers[LAYER_COUNT];
+// The layer being animated
+static layer_state *state = &layers[LAYER_BASE];
+// Low 16 bits of the scheduler's clock for the frame being drawn
+static uint16_t frame_time;
+// Draws frames; woken when the lights change so a faster animation
+// doesn't wait out the old one's frame
+static sched_task *lights_task;
+// LEDs to composite again even if no layer's fade changed them, one bit each
+static uint32_t redraw_leds[LED_MASK_WORDS];
+// How many LEDs the precipitation animation lights at a time, on average
+static uint8_t precip_intensity = 2;
+static forecast_hour forecast[FORECAST_HOURS > 0 ? FORECAST_HOURS : 1];
+static uint8_t forecast_count;
+
+// Output byte for each 8-bit channel level, with gamma correction and the
+// brightness cap applied.  Rebuilt by lights_set_brightness().
+static uint8_t output_levels[256];
+
+// Rounds a channel to the nearest 8-bit level and looks up what to send
+// to the strip for it
+static inline uint8_t output_level(uint16_t channel) {
+  return output_levels[min((channel + 0x80) >> 8, 255)];
+}
+
+static rgb composite_led(int led);
+
+#ifdef LIGHTS_BENCHMARK_SECONDS
+// What frames have cost since the last report
+typedef struct {
+  uint32_t frames;
+  uint32_t animate_us;
+  uint32_t composite_us;
+  uint32_t show_us;
+  uint32_t max_frame_us;
+  uint32_t leds_blended;
+  uint32_t leds_written;
+  uint32_t shows;
+} frame_costs;
+
+static frame_costs costs;
+#define COUNT_COST(field) (costs.field++)
+#else
+#define COUNT_COST(field)
+#endif
+
+/*
+   One NeoPixel strip.  Its pin, length, color order and direction are
+   template parameters, so the code that writes and shows each strip is
+   laid out for it at compile time.
+*/
+template<uint8_t PIN, uint16_t COUNT, neoPixelType TYPE, bool REVERSED>
+struct led_strip {
+  static const uint16_t count = COUNT;
+  static const bool reversed = REVERSED;
+  // Frames are written straight into the strip's pixel buffer, so the byte
+  // offset of each channel is worked out the way the library does it
+  static const uint8_t r_offset = (TYPE >> 4) & 3;
+  static const uint8_t g_offset = (TYPE >> 2) & 3;
+  static const uint8_t b_offset = TYPE & 3;
+  // The library marks strips without a white channel by giving white the
+  // same offset as red
+  static_assert(((TYPE >> 6) & 3) == ((TYPE >> 4) & 3), "only 3-byte RGB strips are supported");
+
+  static Adafruit_NeoPixel strip;
+  // Whether any pixel changed since the strip was last shown
+  static bool changed;
+};
+
+template<uint8_t PIN, uint16_t COUNT, neoPixelType TYPE, bool REVERSED>
+Adafruit_NeoPixel led_strip<PIN, COUNT, TYPE, REVERSED>::strip(COUNT, PIN, TYPE);
+template<uint8_t PIN, uint16_t COUNT, neoPixelType TYPE, bool REVERSED>
+bool led_strip<PIN, COUNT, TYPE, REVERSED>::changed = false;
+
+/*
+   The strips in LED number order, the first starting at LED FIRST.  Each
+   operation handles its own strip and passes on to the rest, which the
+   compiler flattens into straight-line code for each strip.
+*/
+template<uint16_t FIRST, typename... S> struct strip_chain {
+  static const uint16_t count = 0;
+  static void begin() {}
+  static void draw(const uint32_t dirty[]) {}
+  static void show() {}
+};
+
+template<uint16_t FIRST, typename S, typename... Rest> struct strip_chain<FIRST, S, Rest...> {
+  typedef strip_chain<FIRST + S::count, Rest...> next;
+  static const uint16_t count = S::count + next::count;
+  static const uint16_t last = FIRST + S::count - 1;
+
+  static void begin() {
+    S::strip.begin();
+    S::strip.show();
+    // Brightness is applied by our own output table, so the strip
+    // shouldn't scale anything
+    S::strip.setBrightness(255);
+    next::begin();
+  }
+
+  // Composites the LEDs on this strip with bits set in dirty into its
+  // pixel buffer
+  static void draw(const uint32_t dirty[]) {
+    uint8_t *pixels = S::strip.getPixels();
+    for (int w = FIRST / 32; w <= last / 32; w++) {
+      uint32_t bits = dirty[w];
+      if (w == FIRST / 32) {
+        bits &= 0xffffffffUL << (FIRST % 32);
+      }
+      if (w == last / 32) {
+        bits &= 0xffffffffUL >> (31 - last % 32);
+      }
+      while (bits != 0) {
+        int i = w * 32 + __builtin_ctz(bits);
+        bits &= bits - 1;
+
+        rgb cur = composite_led(i);
+        COUNT_COST(leds_blended);
+        uint8_t r = output_level(cur.r);
+        uint8_t g = output_level(cur.g);
+        uint8_t b = output_level(cur.b);
+        uint8_t *pixel = &pixels[(S::reversed ? last - i : i - FIRST) * 3];
+        // Small steps in slow fades often don't change what the LED shows
+        if (pixel[S::r_offset] != r || pixel[S::g_offset] != g || pixel[S::b_offset] != b) {
+          pixel[S::r_offset] = r;
+          pixel[S::g_offset] = g;
+          pixel[S::b_offset] = b;
+          S::changed = true;
+          COUNT_COST(leds_written);
+        }
+      }
+    }
+    next::draw(dirty);
+  }
+
+  // Showing a strip takes about 30 us per LED with interrupts off, so
+  // strips that didn't change are skipped
+  static void show() {
+    if (S::changed) {
+      S::strip.show();
+      S::changed = false;
+      COUNT_COST(shows);
+    }
+    next::show();
+  }
+};
+
+#define LED_STRIP(pin, count, type, reversed) led_strip<pin, count, type, reversed>
+typedef strip_chain<0, LED_STRIPS> strips;
+
+static_assert(strips::count == LED_COUNT, "LED_STRIPS must add up to LED_COUNT");
+
+static unsigned long lights_loop(unsigned long now);
+
+void lights_setup(void) {
+  strips::begin();
+  lights_set_brightness(LIGHTS_BRIGHTNESS);
 
   // 90 starts with a pleasing purple
   randomSeed(90);
 
-  for (int i = 0; i < LED_COUNT; i++) {
-    state.target_colors[i] = colors[COLOR_BLACK];
-    state.current_colors[i] = colors[COLOR_BLACK];
-    state.source_colors[i] = colors[COLOR_BLACK];
+  // Every layer starts out black, and all but the base start out off
+  memset(layers, 0, sizeof(layers));
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    layers[l].animation = ANIM_DEFAULT;
+    layers[l].blend = BLEND_NORMAL;
+    layers[l].fade_mode = FADE_RGB;
+    layers[l].frame_rate = LIGHTS_FRAME_RATE;
+    layers[l].pattern_redraw = true;
   }
 
   // The default animation doesn't care about the other fields
-  state.animation = ANIM_DEFAULT;
-  state.fast = true;
-  state.base_color = COLOR_BLUE;
-  state.highlight_color = COLOR_WHITE;
+  layers[LAYER_BASE].alpha = 255;
+  layers[LAYER_BASE].fast = true;
+  layers[LAYER_BASE].base_color = COLOR_BLUE;
+  layers[LAYER_BASE].highlight_color = COLOR_WHITE;
+
+  // A frame shouldn't take more than a couple of milliseconds
+  lights_task = sched_add("lights", lights_loop, 10);
 }
 
-// Array of [a,b,c,d] becomes [d,a,b,c]
-void rotate_right(byte array[], byte size) {
-  if (size < 2) {
-    return;
+static inline void led_mask_set(uint32_t mask[], int led) {
+  mask[led >> 5] |= 1UL << (led & 31);
+}
+
+static inline bool led_mask_test(const uint32_t mask[], int led) {
+  return (mask[led >> 5] >> (led & 31)) & 1;
+}
+
+static inline rgb palette_color(uint8_t index) {
+  return index <= COLOR_MAX ? colors[index] : adhoc_colors[index - (COLOR_MAX + 1)];
+}
+
+static inline rgb8 pack_rgb(const rgb c) {
+  rgb8 packed = { (uint8_t) min((c.r + 0x80) >> 8, 255),
+                  (uint8_t) min((c.g + 0x80) >> 8, 255),
+                  (uint8_t) min((c.b + 0x80) >> 8, 255)
+                };
+  return packed;
+}
+
+static inline uint32_t fade_scale(uint16_t ms) {
+  return ms == 0 ? 0 : (1UL << 24) / ms;
+}
+
+// 65535 / d, so the color conversions can multiply instead of divide
+struct reciprocal_curve {
+  typedef uint16_t type;
+  static constexpr uint16_t at(unsigned d) {
+    return d == 0 ? 0 : 65535 / d;
   }
-  byte tail = array[size - 1];
-  for (int i = size - 1; i > 0; i--) {
-    array[i] = array[i - 1];
+};
+
+typedef lookup_table<reciprocal_curve, 256> reciprocals;
+
+// x / 255, exactly, for x up to 65535
+static inline uint16_t div255(uint32_t x) {
+  return (x + 1 + (x >> 8)) >> 8;
+}
+
+static hsv rgb_to_hsv(uint8_t r, uint8_t g, uint8_t b) {
+  uint8_t max = MAX3(r, g, b);
+  uint8_t min = MIN3(r, g, b);
+  uint8_t delta = max - min;
+  hsv out;
+
+  out.v = max;
+  if (delta == 0) {
+    out.h = 0;
+    out.s = 0;
+    return out;
   }
-  array[0] = tail;
+  out.s = (delta * 255UL * reciprocals::values[max] + 0x8000) >> 16;
+
+  // How far the middle channel is between the other two, in 1/256ths of a
+  // sixth of a turn, from the sixth the largest channel starts
+  int32_t inv = reciprocals::values[delta];
+  int32_t h;
+  if (max == r) {
+    h = ((g - b) * inv) >> 8;
+  } else if (max == g) {
+    h = 512 + (((b - r) * inv) >> 8);
+  } else {
+    h = 1024 + (((r - g) * inv) >> 8);
+  }
+  out.h = h < 0 ? h + HUE_RANGE : h;
+  return out;
 }
 
+static rgb hsv_to_rgb(hsv c) {
+  uint8_t sector = c.h >> 8;
+  uint8_t f = c.h & 0xff;
+  uint16_t v = c.v;
+  uint16_t p = div255(v * (255 - c.s));
+  uint16_t q = div255(v * (255 - div255(c.s * f)));
+  uint16_t t = div255(v * (255 - div255(c.s * (255 - f))));
+  rgb out;
+
+  switch (sector) {
+    case 0:
+      out = { v, t, p };
+      break;
+    case 1:
+      out = { q, v, p };
+      break;
+    case 2:
+      out = { p, v, t };
+      break;
+    case 3:
+      out = { p, q, v };
+      break;
+    case 4:
+      out = { t, p, v };
+      break;
+    default:
+      out = { v, p, q };
+      break;
+  }
+  out.r <<= 8;
+  out.g <<= 8;
+  out.b <<= 8;
+  return out;
+}
+
+// Where an LED is after some time fading from src to tgt around the color
+// wheel.  Sets *done if it has arrived.  The fade in time applies when the
+// color gets brighter.
+static rgb fade_hsv(const layer_state *layer, rgb8 src, rgb tgt, uint16_t elapsed, bool *done) {
+  rgb8 tgt8 = pack_rgb(tgt);
+  hsv from = rgb_to_hsv(src.r, src.g, src.b);
+  hsv to = rgb_to_hsv(tgt8.r, tgt8.g, tgt8.b);
+  bool brighter = to.v >= from.v;
+  if (elapsed >= (brighter ? layer->fade_in_ms : layer->fade_out_ms)) {
+    return tgt;
+  }
+  *done = false;
+
+  // Grays have no hue of their own, so they take the other end's
+  if (from.s == 0) {
+    from.h = to.h;
+  } else if (to.s == 0) {
+    to.h = from.h;
+  }
+
+  int32_t progress = (elapsed * (brighter ? layer->fade_in_scale : layer->fade_out_scale)) >> 12;
+  int32_t dh = (int32_t) to.h - from.h;
+  if (dh > HUE_RANGE / 2) {
+    dh -= HUE_RANGE;
+  } else if (dh < -HUE_RANGE / 2) {
+    dh += HUE_RANGE;
+  }
+  int32_t h = from.h + ((dh * progress) >> 12);
+
+  hsv cur;
+  cur.h = h < 0 ? h + HUE_RANGE : (h >= HUE_RANGE ? h - HUE_RANGE : h);
+  cur.s = from.s + ((((int32_t) to.s - from.s) * progress) >> 12);
+  cur.v = from.v + ((((int32_t) to.v - from.v) * progress) >> 12);
+  return hsv_to_rgb(cur);
+}
+
+// Where a channel is after some time fading from src to tgt.  Sets *done
+// if it has arrived.
+static inline uint16_t fade_channel(const layer_state *layer, uint8_t src, uint16_t tgt, uint16_t elapsed, bool *done) {
+  int32_t from = (int32_t) src << 8;
+  int32_t diff = (int32_t) tgt - from;
+  uint16_t ms = diff > 0 ? layer->fade_in_ms : layer->fade_out_ms;
+  if (diff == 0 || elapsed >= ms) {
+    return tgt;
+  }
+  *done = false;
+  // Progress through the fade in 1/4096ths; elapsed < ms keeps the
+  // product under 2^24.
+  int32_t progress = (elapsed * (diff > 0 ? layer->fade_in_scale : layer->fade_out_scale)) >> 12;
+  return from + ((diff * progress) >> 12);
+}
+
+// Sets a layer's fade speeds from its fade times
+static void update_fade_scales(layer_state *layer) {
+  layer->fade_in_scale = fade_scale(layer->fade_in_ms);
+  layer->fade_out_scale = fade_scale(layer->fade_out_ms);
+}
+
+// Works out the color an LED should be showing in a layer at the current
+// frame time.  Sets *done if its fade has finished.
+static rgb led_color(const layer_state *layer, int led, bool *done) {
+  rgb tgt = palette_color(layer->targets[led]);
+  *done = true;
+  if (!led_mask_test(layer->fading_leds, led)) {
+    return tgt;
+  }
 
-// Array of [a,b,c,d] becomes [b,c,d,a]
-void rotate_left(byte array[], byte size) {
-  if (size < 2) {
+  rgb8 src = layer->sources[led];
+  uint16_t elapsed = frame_time - layer->fade_starts[led];
+  if (layer->fade_mode == FADE_HSV) {
+    return fade_hsv(layer, src, tgt, elapsed, done);
+  }
+  rgb cur;
+  cur.r = fade_channel(layer, src.r, tgt.r, elapsed, done);
+  cur.g = fade_channel(layer, src.g, tgt.g, elapsed, done);
+  cur.b = fade_channel(layer, src.b, tgt.b, elapsed, done);
+  return cur;
+}
+
+/*
+   Fades the specified LED to a palette entry, starting from whatever it
+   is showing now.
+*/
+static void set_target(const byte led, const uint8_t index) {
+  if (state->targets[led] == index) {
     return;
   }
-  byte head = array[0];
-  for (int i = 0; i < size; i++) {
-    array[i] = array[i + 1];
+  bool done;
+  state->sources[led] = pack_rgb(led_color(state, led, &done));
+  state->targets[led] = index;
+  state->fade_starts[led] = frame_time;
+  led_mask_set(state->fading_leds, led);
+}
+
+// Finds a color already in the palette, or returns -1
+static int find_palette_color(const rgb c) {
+  for (int i = 0; i < PALETTE_SIZE; i++) {
+    rgb p = palette_color(i);
+    if (p.r == c.r && p.g == c.g && p.b == c.b) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Marks the ad-hoc slots some layer's LED is fading to
+static void adhoc_slots_in_use(bool in_use[ADHOC_COLORS]) {
+  memset(in_use, 0, ADHOC_COLORS * sizeof(bool));
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    for (int i = 0; i < LED_COUNT; i++) {
+      if (layers[l].targets[i] > COLOR_MAX) {
+        in_use[layers[l].targets[i] - (COLOR_MAX + 1)] = true;
+      }
+    }
+  }
+}
+
+/*
+   Puts a color in an ad-hoc slot that isn't in use, and marks it used.  If
+   every slot is in use the nearest color in the palette stands in.
+*/
+static uint8_t take_adhoc_slot(const rgb c, bool in_use[ADHOC_COLORS]) {
+  for (int i = 0; i < ADHOC_COLORS; i++) {
+    if (!in_use[i]) {
+      in_use[i] = true;
+      adhoc_colors[i] = c;
+      return COLOR_MAX + 1 + i;
+    }
+  }
+
+  uint8_t nearest = COLOR_BLACK;
+  uint32_t nearest_distance = UINT32_MAX;
+  for (int i = 0; i < PALETTE_SIZE; i++) {
+    rgb p = palette_color(i);
+    int32_t dr = (p.r >> 8) - (c.r >> 8);
+    int32_t dg = (p.g >> 8) - (c.g >> 8);
+    int32_t db = (p.b >> 8) - (c.b >> 8);
+    uint32_t distance = dr * dr + dg * dg + db * db;
+    if (distance < nearest_distance) {
+      nearest = i;
+      nearest_distance = distance;
+    }
+  }
+  return nearest;
+}
+
+/*
+   Finds the palette entry for a color, taking a free ad-hoc slot if it
+   isn't there already.
+*/
+static uint8_t palette_index(const rgb c) {
+  int found = find_palette_color(c);
+  if (found >= 0) {
+    return found;
   }
-  array[size - 1] = head;
+  bool in_use[ADHOC_COLORS];
+  adhoc_slots_in_use(in_use);
+  return take_adhoc_slot(c, in_use);
 }
 
 /*
    Sets the desired RGB color for the specified LED.
 */
 void set_color_rgb(const byte led, const rgb c) {
-  if (state.target_colors[led].r != c.r || state.target_colors[led].g != c.g || state.target_colors[led].b != c.b) {
-    state.target_colors[led] = c;
-    // Reset the source so the next color step knows where we started from
-    state.source_colors[led] = state.current_colors[led];
-  }
+  set_target(led, palette_index(c));
 }
+
 /*
    Sets the desired indexed color for the specified LED.
 */
 void set_color(const byte led, const color color_id) {
-  set_color_rgb(led, colors[color_id]);
+  set_target(led, color_id);
 }
 
-// A randomly twinkling animation
-void animate_precipitation() {
-  static unsigned long last_time = 0;
-  unsigned long time = millis();
-
-  state.fade_in_steps = 4;
-  state.fade_out_steps = 128;
-
-  if (last_time == 0 || time - last_time > (state.fast ? 100 : 256)) {
-    for (byte i = 0; i < LED_COUNT; i++) {
-      byte r = random(LED_COUNT);
-      color color = COLOR_BLACK;
-      if (r == 0) {
-        color = state.base_color;
-      } else if (r == 1) {
-        color = state.highlight_color;
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+/*
+   Patterns are tables of runs of LEDs that move around segments of the
+   strip like rings.  Each segment keeps an offset for how far its pattern
+   has moved, so moving a pattern is O(1), and only the LEDs at the ends of
+   runs change color when it moves one place.
+*/
+
+// Pattern values, which are colored by the animation's configuration
+#define PATTERN_OFF       0
+#define PATTERN_BASE      1
+#define PATTERN_HIGHLIGHT 2
+
+typedef struct {
+  uint8_t value;
+  uint8_t length;
+} pattern_run;
+
+// A section of the strip a pattern moves around
+typedef struct {
+  uint8_t first_led;
+  uint8_t led_count;
+  // 1 moves the pattern toward higher LED numbers, -1 toward lower
+  int8_t direction;
+  const pattern_run *runs;
+  uint8_t run_count;
+} pattern_segment;
+
+typedef struct {
+  const pattern_segment *segments;
+  uint8_t segment_count;
+  // Moves per second
+  uint8_t fast_rate;
+  uint8_t slow_rate;
+  uint16_t fade_in_ms;
+  uint16_t fade_out_ms;
+} pattern;
+
+constexpr unsigned run_lengths(const pattern_run *runs, unsigned count) {
+  return count == 0 ? 0 : runs[0].length + run_lengths(runs + 1, count - 1);
+}
+
+// Colors move in a clockwise circle around the model
+static constexpr pattern_run swirl_runs[] = {
+  {PATTERN_BASE, 9},
+  {PATTERN_HIGHLIGHT, 7},
+  {PATTERN_OFF, LED_COUNT - 16},
+};
+static_assert(run_lengths(swirl_runs, COUNT_OF(swirl_runs)) == LED_COUNT, "swirl runs must cover the strip");
+
+static constexpr pattern_segment swirl_segments[] = {
+  {0, LED_COUNT, 1, swirl_runs, COUNT_OF(swirl_runs)},
+};
+
+// No fade on swirl
+static constexpr pattern swirl_pattern = {swirl_segments, COUNT_OF(swirl_segments), 100, 33, 0, 0};
+
+// Colors move in waves from one end to the other: the bottom half of the
+// strip moves toward higher numbers and the top half toward lower ones
+static constexpr pattern_run flood_bottom_runs[] = {
+  {PATTERN_BASE, 8},
+  {PATTERN_HIGHLIGHT, 8},
+  {PATTERN_OFF, LED_COUNT / 2 - 16},
+};
+static_assert(run_lengths(flood_bottom_runs, COUNT_OF(flood_bottom_runs)) == LED_COUNT / 2, "flood runs must cover the bottom half");
+
+static constexpr pattern_run flood_top_runs[] = {
+  {PATTERN_OFF, LED_COUNT - LED_COUNT / 2 - 16},
+  {PATTERN_HIGHLIGHT, 8},
+  {PATTERN_BASE, 8},
+};
+static_assert(run_lengths(flood_top_runs, COUNT_OF(flood_top_runs)) == LED_COUNT - LED_COUNT / 2, "flood runs must cover the top half");
+
+static constexpr pattern_segment flood_segments[] = {
+  {0, LED_COUNT / 2, 1, flood_bottom_runs, COUNT_OF(flood_bottom_runs)},
+  {LED_COUNT / 2, LED_COUNT - LED_COUNT / 2, -1, flood_top_runs, COUNT_OF(flood_top_runs)},
+};
+
+static_assert(COUNT_OF(flood_segments) <= PATTERN_MAX_SEGMENTS, "too many flood segments");
+
+static constexpr pattern flood_pattern = {flood_segments, COUNT_OF(flood_segments), 66, 25, 0, 0};
+
+// Short highlight dashes chase each other around the model, leaving a
+// fading trail
+static constexpr pattern_run chase_runs[] = {
+  {PATTERN_HIGHLIGHT, 3},
+  {PATTERN_BASE, 14},
+  {PATTERN_HIGHLIGHT, 3},
+  {PATTERN_BASE, 14},
+  {PATTERN_HIGHLIGHT, 3},
+  {PATTERN_BASE, 14},
+  {PATTERN_HIGHLIGHT, 3},
+  {PATTERN_BASE, LED_COUNT - 54},
+};
+static_assert(run_lengths(chase_runs, COUNT_OF(chase_runs)) == LED_COUNT, "chase runs must cover the strip");
+
+static constexpr pattern_segment chase_segments[] = {
+  {0, LED_COUNT, 1, chase_runs, COUNT_OF(chase_runs)},
+};
+
+static constexpr pattern chase_pattern = {chase_segments, COUNT_OF(chase_segments), 40, 15, 0, 300};
+
+color pattern_color(uint8_t value) {
+  switch (value) {
+    case PATTERN_BASE:
+      return state->base_color;
+    case PATTERN_HIGHLIGHT:
+      return state->highlight_color;
+    default:
+      return COLOR_BLACK;
+  }
+}
+
+// Where pattern position 0 of a segment is on the segment right now
+static uint8_t pattern_shift(const pattern_segment *seg, uint8_t offset) {
+  return seg->direction > 0 ? offset : (seg->led_count - offset) % seg->led_count;
+}
+
+// Sets every LED of a pattern
+void draw_pattern(const pattern *pat) {
+  for (int s = 0; s < pat->segment_count; s++) {
+    const pattern_segment *seg = &pat->segments[s];
+    uint8_t shift = pattern_shift(seg, state->pattern_offsets[s]);
+    uint8_t pos = 0;
+    for (int r = 0; r < seg->run_count; r++) {
+      color c = pattern_color(seg->runs[r].value);
+      for (int k = 0; k < seg->runs[r].length; k++, pos++) {
+        set_color(seg->first_led + (pos + shift) % seg->led_count, c);
       }
-      set_color(i, color);
     }
-    last_time = time;
   }
 }
 
-// Colors move in waves from one end to the other
-void animate_flood() {
-  static unsigned long last_time = 0;
-  unsigned long time = millis();
+// Moves a pattern one place.  Moving toward higher numbers, each run grows
+// by one at its end; moving toward lower numbers, at its start.  The other
+// end is taken over by the neighboring run, so those are the only LEDs
+// that change.
+void advance_pattern(const pattern *pat) {
+  for (int s = 0; s < pat->segment_count; s++) {
+    const pattern_segment *seg = &pat->segments[s];
+    state->pattern_offsets[s] = (state->pattern_offsets[s] + 1) % seg->led_count;
+    uint8_t shift = pattern_shift(seg, state->pattern_offsets[s]);
+    uint8_t pos = 0;
+    for (int r = 0; r < seg->run_count; r++) {
+      const pattern_run *run = &seg->runs[r];
+      uint8_t end = seg->direction > 0 ? pos + run->length - 1 : pos;
+      set_color(seg->first_led + (end + shift) % seg->led_count, pattern_color(run->value));
+      pos += run->length;
+    }
+  }
+}
 
-  // Set the colors from the queue
-  color color_ids[3];
-  color_ids[0] = COLOR_BLACK;
-  color_ids[1] = state.base_color;
-  color_ids[2] = state.highlight_color;
+// Arduino's random() goes through the C library and a modulo for every
+// number, which adds up when animations want one per LED per frame.  This
+// is xorshift32: a few shifts and 4 bytes of state.  Any nonzero seed works.
+static uint32_t random_state = 90;
 
-  for (uint8_t i; i < LED_COUNT; i++) {
-    set_color(i, color_ids[flood_queue[i]]);
-  }
+static inline uint32_t fast_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
 
-  state.fade_in_steps = 1;
-  state.fade_out_steps = 1;
+// A random number from 0 to n - 1, by scaling rather than modulo
+static inline uint16_t fast_random_below(uint16_t n) {
+  return ((fast_random() >> 16) * n) >> 16;
+}
+
+// log2(1 + i / 32) in 1/256ths
+static const uint16_t log2_fractions[33] = {
+  0, 11, 22, 33, 44, 54, 63, 73, 82, 92, 100, 109, 118, 126, 134, 142,
+  150, 157, 165, 172, 179, 186, 193, 200, 207, 213, 220, 226, 232, 238, 244, 250,
+  256
+};
+
+/*
+   An exponentially distributed random number, as -log2(u) for a uniform u
+   in (0, 1), in 1/4096ths.  The whole part is the count of leading zero
+   bits and the fraction is interpolated from the table using the bits
+   after the leading one, so there are no logarithms to compute.
+*/
+static uint32_t random_exponential(void) {
+  uint32_t x = fast_random();
+  int zeros = __builtin_clz(x);
+  uint32_t mantissa = (x << zeros) >> 16 & 0x7fff;
+  uint8_t i = mantissa >> 10;
+  uint32_t fraction = (log2_fractions[i] << 4) + (((log2_fractions[i + 1] - log2_fractions[i]) * (mantissa & 0x3ff)) >> 6);
+  return ((zeros + 1) << 12) - fraction;
+}
+
+/*
+   A randomly twinkling animation.  Each LED lights with a small chance
+   each update, so rather than rolling for every LED, we draw the gaps
+   between lit ones, which are geometrically distributed, and jump from
+   one to the next.  The work is proportional to the LEDs lit.
+*/
+void animate_precipitation() {
+  unsigned long time = sched_now();
+
+  state->fade_in_ms = 20;
+  state->fade_out_ms = 500;
+  state->fade_mode = FADE_RGB;
+  state->frame_rate = LIGHTS_FRAME_RATE;
 
-  // Rotate the bottom half to the right, top half to the left
-  if (time - last_time > (state.fast ? 15 : 40)) {
-    rotate_right(flood_queue, LED_COUNT / 2);
-    rotate_left(flood_queue + (LED_COUNT / 2), LED_COUNT / 2);
-    last_time = time;
+  if (state->anim_time == 0 || time - state->anim_time > (state->fast ? 100 : 256)) {
+    uint32_t lit[LED_MASK_WORDS] = { 0 };
+
+    if (precip_intensity > 0) {
+      // Flooring an exponential with mean m gives a geometric gap with
+      // mean about m - 1/2.  The ln 2 (177/256) turns random_exponential()
+      // from log2 units into a mean of 1.
+      uint32_t mean = ((uint32_t) LED_COUNT << 8) / precip_intensity;
+      uint32_t gap_scale = ((mean > 128 ? mean - 128 : 0) * 177) >> 8;
+      int i = -1;
+      while ((i += 1 + ((random_exponential() * gap_scale) >> 20)) < LED_COUNT) {
+        led_mask_set(lit, i);
+        set_color(i, fast_random() & 1 ? state->highlight_color : state->base_color);
+      }
+    }
+
+    // Put out the ones that aren't lit any more
+    for (int w = 0; w < LED_MASK_WORDS; w++) {
+      uint32_t bits = state->precip_lit[w] & ~lit[w];
+      while (bits != 0) {
+        set_color(w * 32 + __builtin_ctz(bits), COLOR_BLACK);
+        bits &= bits - 1;
+      }
+      state->precip_lit[w] = lit[w];
+    }
+    state->anim_time = time;
   }
 }
 
+// How long the pulse holds each color, fast and slow
+#define PULSE_FAST_MS 1024
+#define PULSE_SLOW_MS 4096
+
 void animate_pulse() {
-  static unsigned long last_time = 0;
-  static boolean flip = false;
-  unsigned long time = millis();
+  unsigned long time = sched_now();
 
-  state.fade_in_steps = 128;
-  state.fade_out_steps = 128;
+  state->fade_in_ms = 500;
+  state->fade_out_ms = 500;
+  state->fade_mode = FADE_RGB;
+  state->frame_rate = LIGHTS_FRAME_RATE;
 
-  if (last_time == 0 || time - last_time > (state.fast ? 1024 : 4096)) {
+  unsigned long period = state->fast ? PULSE_FAST_MS : PULSE_SLOW_MS;
+  if (state->anim_time == 0 || time - state->anim_time > period) {
     for (int i = 0; i < LED_COUNT; i++) {
-      if (flip) {
-        set_color(i, state.base_color);
+      if (state->anim_step & 1) {
+        set_color(i, state->base_color);
       } else {
-        set_color(i, state.highlight_color);
+        set_color(i, state->highlight_color);
       }
     }
-    flip = !flip;
-    last_time = time;
+    state->anim_step++;
+    state->anim_time = time;
   }
+  // The next change comes once more than a period has passed
+  state->next_change = state->anim_time + period + 1;
+  state->next_change_known = true;
 }
 
-// Colors move in a clockwise circle around the model
-void animate_swirl() {
-  static unsigned long last_time = 0;
-  unsigned long time = millis();
+// Moves the layer's pattern along at its rate, or draws all of it if it
+// just became active.  Frames may come faster than the pattern moves when
+// another layer wants them.
+void animate_pattern(const pattern *pat) {
+  unsigned long time = sched_now();
+
+  state->fade_in_ms = pat->fade_in_ms;
+  state->fade_out_ms = pat->fade_out_ms;
+  state->fade_mode = FADE_RGB;
+  state->frame_rate = state->fast ? pat->fast_rate : pat->slow_rate;
+
+  if (state->pattern_redraw) {
+    draw_pattern(pat);
+    state->pattern_redraw = false;
+    state->anim_time = time;
+    return;
+  }
+
+  unsigned long move_ms = 1000 / state->frame_rate;
+  // After a long stall, pick up from here rather than racing to catch up
+  if (time - state->anim_time > 1000) {
+    state->anim_time = time - move_ms;
+  }
+  while (time - state->anim_time >= move_ms) {
+    advance_pattern(pat);
+    state->anim_time += move_ms;
+  }
+}
+
+// A pseudo-random 0-255 for each point of a 256x256 lattice that wraps
+static inline uint8_t lattice_value(uint16_t x, uint16_t y) {
+  uint32_t h = (x & 0xff) * 0x9e3779b1UL + (y & 0xff) * 0x85ebca77UL;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6dUL;
+  h ^= h >> 13;
+  return h >> 24;
+}
+
+/*
+   Value noise: random values at lattice points, eased between with the
+   smoothstep table.  x and y are lattice coordinates with 8 bits of
+   fraction, and wrap around; the result is 0-255.
+*/
+static uint8_t value_noise(uint16_t x, uint16_t y) {
+  uint16_t xi = x >> 8;
+  uint16_t yi = y >> 8;
+  int16_t fx = smoothstep_levels::values[x & 0xff];
+  int16_t fy = smoothstep_levels::values[y & 0xff];
+
+  int16_t a = lattice_value(xi, yi);
+  int16_t b = lattice_value(xi + 1, yi);
+  int16_t c = lattice_value(xi, yi + 1);
+  int16_t d = lattice_value(xi + 1, yi + 1);
+  int16_t front = a + (((b - a) * fx) >> 8);
+  int16_t back = c + (((d - c) * fx) >> 8);
+  return front + (((back - front) * fy) >> 8);
+}
 
-  // Set the colors from the queue
-  color color_ids[3];
-  color_ids[0] = COLOR_BLACK;
-  color_ids[1] = state.base_color;
-  color_ids[2] = state.highlight_color;
+// Steps of blend between the base and highlight colors that geometric
+// animations draw with.  Each is a palette entry, so they don't need
+// memory per LED; fades smooth over the steps.
+#define BLEND_LEVELS 8
 
-  for (uint8_t i; i < LED_COUNT; i++) {
-    set_color(i, color_ids[swirl_queue[i]]);
+static uint8_t blend_palette[BLEND_LEVELS];
+
+static void make_blend_palette() {
+  rgb base = colors[state->base_color];
+  rgb highlight = colors[state->highlight_color];
+  // No LED targets the levels yet, so the slots they take are kept here
+  // or each level would take the same one
+  bool in_use[ADHOC_COLORS];
+  adhoc_slots_in_use(in_use);
+  for (int l = 0; l < BLEND_LEVELS; l++) {
+    rgb c;
+    c.r = base.r + ((int32_t) highlight.r - base.r) * l / (BLEND_LEVELS - 1);
+    c.g = base.g + ((int32_t) highlight.g - base.g) * l / (BLEND_LEVELS - 1);
+    c.b = base.b + ((int32_t) highlight.b - base.b) * l / (BLEND_LEVELS - 1);
+    int found = find_palette_color(c);
+    if (found > COLOR_MAX) {
+      in_use[found - (COLOR_MAX + 1)] = true;
+    }
+    blend_palette[l] = found >= 0 ? found : take_adhoc_slot(c, in_use);
   }
+}
 
-  // No fade on swirl
-  state.fade_in_steps = 1;
-  state.fade_out_steps = 1;
+// Patches of the highlight color drift over the base from left to right,
+// like blowing dust or fog
+void animate_drift() {
+  unsigned long time = sched_now();
 
-  // Rotate the queue one place if the period has elapsed
-  if (time - last_time > (state.fast ? 10 : 30)) {
-    rotate_right(swirl_queue, LED_COUNT);
-    last_time = time;
+  state->fade_in_ms = 150;
+  state->fade_out_ms = 150;
+  state->fade_mode = FADE_RGB;
+  state->frame_rate = LIGHTS_FRAME_RATE;
+
+  if (state->anim_time == 0 || time - state->anim_time >= 100) {
+    make_blend_palette();
+    // Lattice cells move by this much (in 1/256ths) each update
+    state->anim_step += state->fast ? 40 : 10;
+    uint16_t offset = state->anim_step;
+    for (int i = 0; i < LED_COUNT; i++) {
+      led_position pos = led_positions::values[i];
+      // About four cells across the cloud and one front to back.  Value
+      // noise stays near the middle, so stretch it to use all the levels.
+      int16_t level = value_noise(pos.x * 4 - offset, pos.y) * 3 / 2 - 64;
+      level = constrain(level, 0, 255);
+      set_target(i, blend_palette[level * BLEND_LEVELS >> 8]);
+    }
+    state->anim_time = time;
   }
 }
 
 // Colors fade in and out slowly at random locations
 void animate_default() {
-  static unsigned long next_time = 0;
-  unsigned long time = millis();
+  unsigned long time = sched_now();
 
-  state.fade_in_steps = 512;
-  state.fade_out_steps = 1024;
+  // Slow fades look smooth at a low frame rate
+  state->fade_in_ms = 2000;
+  state->fade_out_ms = 4000;
+  // Hue fades keep the colors vivid on the way between them
+  state->fade_mode = FADE_HSV;
+  state->frame_rate = 25;
 
-  if (next_time == 0 || time > next_time) {
+  if (state->anim_time == 0 || time_reached(time, state->anim_time)) {
     rgb new_color;
-    new_color.r = random(256) / 255.0;
-    new_color.g = random(256) / 255.0;
-    new_color.b = random(256) / 255.0;
+    new_color.r = random(256) << 8;
+    new_color.g = random(256) << 8;
+    new_color.b = random(256) << 8;
 
     // Cut one channel down so we get more vivid colors
     switch (random(3)) {
       case 0:
-        new_color.r /= 3.0;
+        new_color.r /= 3;
         break;
       case 1:
-        new_color.g /= 3.0;
+        new_color.g /= 3;
         break;
       case 2:
-        new_color.b /= 3.0;
+        new_color.b /= 3;
         break;
     }
 
@@ -323,134 +1147,451 @@ void animate_default() {
       }
     }
 
-    next_time = time + random(1000, 10000);
+    state->anim_time = time + random(1000, 10000);
   }
+  state->next_change = state->anim_time;
+  state->next_change_known = true;
 }
 
-/*
-   Changes the "current" colors to be one step closer to the "target" colors.
-   Colors are interpolated linearly by channel.
-*/
-void step_colors() {
-  for (int i = 0; i < LED_COUNT; i++) {
-    rgb tgt = state.target_colors[i];
-    rgb cur = state.current_colors[i];
-    rgb src = state.source_colors[i];
-
-    /*
-       Each step moves "cur" closer to "tgt" by an amount that's a fraction of
-       the original difference between "src" and "tgt".  When other functions
-       change the "tgt", they must also set the "src" to "cur" so we can calculate
-       new step sizes.
-    */
-
-    float diff_r = tgt.r - cur.r;
-    float diff_g = tgt.g - cur.g;
-    float diff_b = tgt.b - cur.b;
-
-    if (abs(diff_r) >= FLT_EPSILON) {
-      int steps = diff_r > 0.0 ? state.fade_in_steps : state.fade_out_steps;
-      float step = (tgt.r - src.r) / steps;
-      if (diff_r < 0.0) {
-        cur.r += max(diff_r, step);
-      } else {
-        cur.r += min(diff_r, step);
-      }
-    }
+// Temperatures at which the forecast animation shows each color, coldest
+// first.  Temperatures in between get a blend.
+typedef struct {
+  int16_t temperature;
+  color color_id;
+} temperature_color;
 
-    if (abs(diff_g) >= FLT_EPSILON) {
-      int steps = diff_g > 0.0 ? state.fade_in_steps : state.fade_out_steps;
-      float step = (tgt.g - src.g) / steps;
-      if (diff_g < 0.0) {
-        cur.g += max(diff_g, step);
-      } else {
-        cur.g += min(diff_g, step);
-      }
+static const temperature_color temperature_colors[] = {
+  {10, COLOR_DARK_BLUE},
+  {32, COLOR_LIGHT_BLUE},
+  {60, COLOR_YELLOW},
+  {80, COLOR_ORANGE},
+  {95, COLOR_RED},
+};
+
+rgb lookup_temperature_rgb(int16_t temperature) {
+  const int last = sizeof(temperature_colors) / sizeof(temperature_colors[0]) - 1;
+  if (temperature <= temperature_colors[0].temperature) {
+    return colors[temperature_colors[0].color_id];
+  }
+  for (int i = 1; i <= last; i++) {
+    const temperature_color *hi = &temperature_colors[i];
+    if (temperature < hi->temperature) {
+      const temperature_color *lo = &temperature_colors[i - 1];
+      // How far between the two colors we are, 0-256
+      int32_t t = (int32_t) (temperature - lo->temperature) * 256 / (hi->temperature - lo->temperature);
+      rgb a = colors[lo->color_id];
+      rgb b = colors[hi->color_id];
+      rgb c;
+      c.r = a.r + (((int32_t) b.r - a.r) * t >> 8);
+      c.g = a.g + (((int32_t) b.g - a.g) * t >> 8);
+      c.b = a.b + (((int32_t) b.b - a.b) * t >> 8);
+      return c;
     }
+  }
+  return colors[temperature_colors[last].color_id];
+}
+
+// How often the forecast's twinkling is redrawn
+#define FORECAST_REDRAW_MS 500
+
+// Each hour of the forecast gets a slice of the cloud.  Its color
+// shows the temperature, and its precipitation color twinkles through it
+// more often the more likely precipitation is.
+void animate_forecast() {
+  unsigned long time = sched_now();
+
+  if (forecast_count == 0) {
+    animate_default();
+    return;
+  }
+
+  state->fade_in_ms = 250;
+  state->fade_out_ms = 1000;
+  state->fade_mode = FADE_RGB;
+  state->frame_rate = LIGHTS_FRAME_RATE;
 
-    if (abs(diff_b) >= FLT_EPSILON) {
-      int steps = diff_b > 0.0 ? state.fade_in_steps : state.fade_out_steps;
-      float step = (tgt.b - src.b) / steps;
-      if (diff_b < 0.0) {
-        cur.b += max(diff_b, step);
+  if (state->anim_time == 0 || time - state->anim_time > FORECAST_REDRAW_MS) {
+    for (int i = 0; i < LED_COUNT; i++) {
+      // Hours go around the cloud like a clock, starting at the front
+      const forecast_hour *hour = &forecast[led_positions::values[i].angle * forecast_count >> 8];
+      if (hour->precip_color != COLOR_BLACK && fast_random_below(400) < hour->precip_chance) {
+        set_color(i, hour->precip_color);
       } else {
-        cur.b += min(diff_b, step);
+        set_color_rgb(i, lookup_temperature_rgb(hour->temperature));
       }
     }
+    state->anim_time = time;
+  }
+  state->next_change = state->anim_time + FORECAST_REDRAW_MS + 1;
+  state->next_change_known = true;
+}
 
-    state.current_colors[i] = cur;
+// Combines a layer's color with the color of the layers under it
+static rgb blend_rgb(rgb under, rgb over, blend_mode mode, uint8_t alpha) {
+  rgb mixed;
+  switch (mode) {
+    case BLEND_ADD:
+      mixed.r = min(under.r + over.r, 0xff00);
+      mixed.g = min(under.g + over.g, 0xff00);
+      mixed.b = min(under.b + over.b, 0xff00);
+      break;
+    case BLEND_LIGHTEN:
+      mixed.r = max(under.r, over.r);
+      mixed.g = max(under.g, over.g);
+      mixed.b = max(under.b, over.b);
+      break;
+    case BLEND_NORMAL:
+    default:
+      mixed = over;
+      break;
+  }
 
-    if (cur.r == tgt.r && cur.g == tgt.g && cur.b == tgt.b) {
-      state.source_colors[i] = tgt;
+  // An alpha of 255 takes all of the mix
+  int32_t weight = alpha + 1;
+  rgb out;
+  out.r = under.r + ((((int32_t) mixed.r - under.r) * weight) >> 8);
+  out.g = under.g + ((((int32_t) mixed.g - under.g) * weight) >> 8);
+  out.b = under.b + ((((int32_t) mixed.b - under.b) * weight) >> 8);
+  return out;
+}
+
+// Blends the layers' colors for one LED, finishing any fades that are done
+static rgb composite_led(int led) {
+  uint32_t bit = 1UL << (led & 31);
+  rgb cur = colors[COLOR_BLACK];
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    layer_state *layer = &layers[l];
+    if (layer->alpha == 0) {
+      continue;
+    }
+    bool done;
+    rgb c = led_color(layer, led, &done);
+    if (done && (layer->fading_leds[led >> 5] & bit)) {
+      // Later fades start from here
+      layer->sources[led] = pack_rgb(c);
+      layer->fading_leds[led >> 5] &= ~bit;
     }
+    cur = blend_rgb(cur, c, layer->blend, layer->alpha);
   }
+  return cur;
 }
 
 /*
-   Updates the colors of all the LEDs to their "current" colors.
+   Blends the layers into the strips' pixel buffers.  Only LEDs that some
+   layer is fading (or that need redrawing after a layer or the brightness
+   changed) are visited; the rest keep the bytes they have.  Fades are
+   worked out in each layer's fade space from the source captured when its
+   target changed.
 */
-void update_leds() {
-  for (int i = 0; i < LED_COUNT; i++) {
-    rgb rgb = state.current_colors[i];
-    strip.setPixelColor(i, rgb.r * 255, rgb.g * 255, rgb.b * 255);
+void composite_leds() {
+  uint32_t dirty[LED_MASK_WORDS];
+
+  memcpy(dirty, redraw_leds, sizeof(dirty));
+  memset(redraw_leds, 0, sizeof(redraw_leds));
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    if (layers[l].alpha > 0) {
+      update_fade_scales(&layers[l]);
+      for (int w = 0; w < LED_MASK_WORDS; w++) {
+        dirty[w] |= layers[l].fading_leds[w];
+      }
+    }
   }
-  strip.show();
+  strips::draw(dirty);
 }
 
+// Shows the strips whose pixels changed
+void update_leds() {
+  strips::show();
+}
 
-void print_state() {
-#ifdef DEBUG
-  Serial.println("new state:");
-  Serial.print("  animation: ");
-  Serial.println(state.animation);
-  Serial.print("  fast: ");
-  Serial.println(state.fast);
-  Serial.print("  base color: ");
-  Serial.println(state.base_color);
-  Serial.print("  highlight color: ");
-  Serial.println(state.highlight_color);
-#endif
+
+void print_state(light_layer l) {
+  layer_state *layer = &layers[l];
+  LOG_INFO("new state for layer %d: animation %d, fast %d, base color %d, highlight color %d",
+           l, layer->animation, layer->fast, layer->base_color, layer->highlight_color);
 }
 
 void print_rgb(rgb rgb) {
 #ifdef DEBUG
-  Serial.print(rgb.r);
+  Serial.print(rgb.r >> 8);
   Serial.print(",");
-  Serial.print(rgb.g);
+  Serial.print(rgb.g >> 8);
   Serial.print(",");
-  Serial.print(rgb.b);
+  Serial.print(rgb.b >> 8);
   Serial.print(" ");
 #endif
 }
 
-void lights_loop(void) {
-  switch (state.animation) {
+#ifdef LIGHTS_BENCHMARK_SECONDS
+// Prints per-frame averages of what frames have cost, then starts over
+static void print_costs() {
+  uint32_t frames = max(costs.frames, 1UL);
+  Serial.print("lights:");
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    if (layers[l].alpha > 0) {
+      Serial.print(" layer ");
+      Serial.print(l);
+      Serial.print(" anim ");
+      Serial.print(layers[l].animation);
+      Serial.print(layers[l].fast ? " fast" : " slow");
+      Serial.print(",");
+    }
+  }
+  Serial.print(" ");
+  Serial.print(costs.frames);
+  Serial.print(" frames, us/frame: animate ");
+  Serial.print(costs.animate_us / frames);
+  Serial.print(" composite ");
+  Serial.print(costs.composite_us / frames);
+  Serial.print(" show ");
+  Serial.print(costs.show_us / frames);
+  Serial.print(" worst ");
+  Serial.print(costs.max_frame_us);
+  Serial.print(", per frame: blended ");
+  Serial.print(costs.leds_blended / frames);
+  Serial.print(" written ");
+  Serial.print(costs.leds_written / frames);
+  Serial.print(" shows ");
+  Serial.print((float) costs.shows / frames);
+  Serial.println();
+  memset(&costs, 0, sizeof(costs));
+}
+#endif
+
+// Runs the animation of the layer in state
+static void animate_layer() {
+  switch (state->animation) {
     case ANIM_PRECIP:
       animate_precipitation();
       break;
     case ANIM_FLOOD:
-      animate_flood();
+      animate_pattern(&flood_pattern);
       break;
     case ANIM_PULSE:
       animate_pulse();
       break;
     case ANIM_SWIRL:
-      animate_swirl();
+      animate_pattern(&swirl_pattern);
+      break;
+    case ANIM_CHASE:
+      animate_pattern(&chase_pattern);
+      break;
+    case ANIM_FORECAST:
+      animate_forecast();
+      break;
+    case ANIM_DRIFT:
+      animate_drift();
       break;
     case ANIM_DEFAULT:
     default:
       animate_default();
       break;
   }
+}
+
+/*
+   How long the lights can go without a frame once this one is out.  When
+   no LED is fading and every layer's animation knows when it next changes
+   anything, frames until then would draw nothing, so the loop can sleep
+   through them.  Anything that changes the lights from outside wakes the
+   lights task.  With every layer off there's nothing to wait for, and this
+   is ULONG_MAX, which the scheduler cuts down to SCHED_MAX_WAIT_MS.
+*/
+static unsigned long lights_idle_ms(unsigned long now) {
+  unsigned long idle = ULONG_MAX;
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    layer_state *layer = &layers[l];
+    if (layer->alpha == 0) {
+      continue;
+    }
+    if (!layer->next_change_known || time_reached(now, layer->next_change)) {
+      return 0;
+    }
+    for (int w = 0; w < LED_MASK_WORDS; w++) {
+      if (layer->fading_leds[w] != 0) {
+        return 0;
+      }
+    }
+    idle = min(idle, layer->next_change - now);
+  }
+  return idle;
+}
+
+#ifdef PROFILE
+// When the scheduler will next run the lights if nothing wakes them
+// sooner, so a frame counts as late only by how long after that it starts
+static unsigned long profile_frame_due;
+static bool profile_frame_due_known = false;
+#endif
+
+// Returns wait from lights_loop(), noting when that makes the lights due
+static unsigned long lights_wait(unsigned long now, unsigned long wait) {
+#ifdef PROFILE
+  profile_frame_due = now + min(wait, SCHED_MAX_WAIT_MS);
+  profile_frame_due_known = true;
+#endif
+  return wait;
+}
+
+// Draws a frame if one's due, and returns the milliseconds until the next
+static unsigned long lights_loop(unsigned long now) {
+  static unsigned long last_frame = 0;
+
+  // Frames come as often as the fastest layer wants them
+  uint16_t frame_rate = 1;
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    if (layers[l].alpha > 0) {
+      frame_rate = max(frame_rate, layers[l].frame_rate);
+    }
+  }
+
+  // Nothing to do until the next frame is due.  If we were held up for
+  // more than a frame, fades catch up so their speed doesn't depend on how
+  // busy the rest of the loop is.
+  unsigned long frame_ms = 1000 / frame_rate;
+  unsigned long elapsed = now - last_frame;
+  if (elapsed < frame_ms) {
+    return lights_wait(now, frame_ms - elapsed);
+  }
+  last_frame = now - elapsed % frame_ms;
+  frame_time = now;
+#ifdef PROFILE
+  // Only to the millisecond, since that's what the frames are paced by
+  if (profile_frame_due_known) {
+    unsigned long late = time_reached(now, profile_frame_due) ? now - profile_frame_due : 0;
+    profile_record(PROBE_FRAME_LATE, min(late, ULONG_MAX / 1000) * 1000);
+  }
+  bool measure_stack = profile_frame_stack_due();
+#endif
 
-  step_colors();
+#ifdef LIGHTS_BENCHMARK_SECONDS
+  static unsigned long last_report = now;
+  unsigned long frame_start = micros();
+#endif
+
+#ifdef PROFILE
+  if (measure_stack) {
+    profile_stack_begin();
+  }
+#endif
+  PROFILE_START(animate_start);
+  for (int l = 0; l < LAYER_COUNT; l++) {
+    if (layers[l].alpha > 0) {
+      state = &layers[l];
+      // Fades in progress were planned with the fade times the layer had
+      // last frame
+      update_fade_scales(state);
+      state->next_change_known = false;
+      animate_layer();
+    }
+  }
+  state = &layers[LAYER_BASE];
+  PROFILE_END(PROBE_ANIMATE, animate_start);
+
+#ifdef LIGHTS_BENCHMARK_SECONDS
+  unsigned long animated = micros();
+#endif
+
+  PROFILE_START(composite_start);
+  composite_leds();
+  PROFILE_END(PROBE_COMPOSITE, composite_start);
+
+#ifdef LIGHTS_BENCHMARK_SECONDS
+  unsigned long composited = micros();
+#endif
+
+  PROFILE_START(show_start);
   update_leds();
+  PROFILE_END(PROBE_SHOW, show_start);
+#ifdef PROFILE
+  if (measure_stack) {
+    profile_stack_end(PHASE_FRAME);
+  }
+#endif
+
+#ifdef LIGHTS_BENCHMARK_SECONDS
+  unsigned long shown = micros();
+  costs.frames++;
+  costs.animate_us += animated - frame_start;
+  costs.composite_us += composited - animated;
+  costs.show_us += shown - composited;
+  costs.max_frame_us = max(costs.max_frame_us, shown - frame_start);
+  if (now - last_report >= LIGHTS_BENCHMARK_SECONDS * 1000UL) {
+    print_costs();
+    last_report = now;
+  }
+#endif
+
+  return lights_wait(now, max(frame_ms - (now - last_frame), lights_idle_ms(now)));
+}
+
+void lights_configure_layer(light_layer l, anim animation, bool fast, color base_color, color highlight_color) {
+  layer_state *layer = &layers[l];
+  // The weather is polled again and again; the same answer shouldn't
+  // start the animation over
+  if (animation == layer->animation && fast == layer->fast && base_color == layer->base_color &&
+      highlight_color == layer->highlight_color) {
+    return;
+  }
+
+  layer->animation = animation;
+  layer->fast = fast;
+  layer->base_color = base_color;
+  layer->highlight_color = highlight_color;
+
+  // Animations start over from the beginning
+  layer->anim_time = 0;
+  layer->anim_step = 0;
+  memset(layer->pattern_offsets, 0, sizeof(layer->pattern_offsets));
+  layer->pattern_redraw = true;
+  // Precipitation starts by putting out whatever was showing
+  for (int i = 0; i < LED_COUNT; i++) {
+    led_mask_set(layer->precip_lit, i);
+  }
+  print_state(l);
+  sched_wake(lights_task);
 }
 
 void lights_configure(anim animation, bool fast, color base_color, color highlight_color) {
-  state.animation = animation;
-  state.fast = fast;
-  state.base_color = base_color;
-  state.highlight_color = highlight_color;
-  print_state();
+  lights_configure_layer(LAYER_BASE, animation, fast, base_color, highlight_color);
+}
+
+void lights_set_layer_blend(light_layer l, blend_mode mode, uint8_t alpha) {
+  layer_state *layer = &layers[l];
+  if (layer->blend == mode && layer->alpha == alpha) {
+    return;
+  }
+  layer->blend = mode;
+  layer->alpha = alpha;
+
+  // A layer that's off doesn't keep fading, so it doesn't come back with
+  // fades that have gone stale
+  if (alpha == 0) {
+    memset(layer->fading_leds, 0, sizeof(layer->fading_leds));
+  }
+  for (int i = 0; i < LED_COUNT; i++) {
+    led_mask_set(redraw_leds, i);
+  }
+  sched_wake(lights_task);
+}
+
+void lights_set_forecast(const forecast_hour *hours, uint8_t count) {
+  forecast_count = min(count, sizeof(forecast) / sizeof(forecast[0]));
+  memcpy(forecast, hours, forecast_count * sizeof(forecast_hour));
+}
+
+void lights_set_brightness(uint8_t brightness) {
+  for (int i = 0; i < 256; i++) {
+    output_levels[i] = (gamma_levels::values[i] * (brightness + 1)) >> 8;
+  }
+
+  // Everything needs to be sent again at the new brightness
+  for (int i = 0; i < LED_COUNT; i++) {
+    led_mask_set(redraw_leds, i);
+  }
+  sched_wake(lights_task);
+}
+
+void lights_set_intensity(uint8_t intensity) {
+  precip_intensity = intensity;
 }
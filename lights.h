@@ -26,6 +26,9 @@ typedef enum {
   ANIM_FLOOD,
   ANIM_PULSE,
   ANIM_SWIRL,
+  ANIM_FORECAST,
+  ANIM_CHASE,
+  ANIM_DRIFT,
 } anim;
 
 typedef enum {
@@ -44,8 +47,43 @@ typedef enum {
 
 #define COLOR_MAX COLOR_ORANGE
 
+// Layers are drawn bottom to top, each with its own animation
+typedef enum {
+  // What lights_configure() sets; the weather, or the calm default
+  LAYER_BASE,
+  // Alerts drawn over the base
+  LAYER_OVERLAY,
+  // Signs of trouble with the connection or the weather service
+  LAYER_STATUS,
+  LAYER_COUNT,
+} light_layer;
+
+// How a layer combines with the layers under it, before its alpha
+typedef enum {
+  // The layer's color replaces what's under it
+  BLEND_NORMAL,
+  // The layer's color is added to what's under it, so black is clear
+  BLEND_ADD,
+  // The brighter of the two, channel by channel
+  BLEND_LIGHTEN,
+} blend_mode;
+
+// One hour of the forecast shown by ANIM_FORECAST
+typedef struct {
+  // Degrees Fahrenheit
+  int16_t temperature;
+  // Percent
+  uint8_t precip_chance;
+  // Color of the precipitation expected, or COLOR_BLACK for none
+  color precip_color;
+} forecast_hour;
+
 void lights_setup(void);
-void lights_loop(void);
 void lights_configure(anim animation, bool fast, color base_color, color highlight_color);
+void lights_configure_layer(light_layer l, anim animation, bool fast, color base_color, color highlight_color);
+void lights_set_layer_blend(light_layer l, blend_mode mode, uint8_t alpha);
+void lights_set_forecast(const forecast_hour *hours, uint8_t count);
+void lights_set_brightness(uint8_t brightness);
+void lights_set_intensity(uint8_t intensity);
 
 #endif /* __LIGHTS_H_ */
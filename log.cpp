@@ -0,0 +1,185 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "log.h"
+
+// Messages waiting to be written, each a length byte and then that many
+// bytes: the format pointer, then the arguments in order.  head and tail
+// count up forever and are masked to index the buffer.
+static uint8_t ring[LOG_BUFFER_SIZE];
+static uint16_t head = 0;
+static uint16_t tail = 0;
+static unsigned long dropped = 0;
+
+// The message being written out, and how much of it has been
+static char line[LOG_MAX_RECORD + 2];
+static uint8_t line_len = 0;
+static uint8_t line_pos = 0;
+
+void log_begin(log_record *rec, const char *format) {
+  memcpy(rec->bytes, &format, sizeof(format));
+  rec->len = sizeof(format);
+}
+
+// Numbers are kept as 32 bits whatever the width of long, so the host
+// formats them the way the board does
+void log_arg(log_record *rec, unsigned long value) {
+  uint32_t number = value;
+  if (rec->len + sizeof(number) <= sizeof(rec->bytes)) {
+    memcpy(rec->bytes + rec->len, &number, sizeof(number));
+    rec->len += sizeof(number);
+  }
+}
+
+void log_arg(log_record *rec, const char *value) {
+  // Strings are always terminated, however much of them fits
+  int room = min(LOG_MAX_STRING, (int) sizeof(rec->bytes) - rec->len - 1);
+  if (room < 0) {
+    return;
+  }
+  uint8_t *out = rec->bytes + rec->len;
+  int n = 0;
+  while (n < room && value[n] != '\0') {
+    out[n] = value[n];
+    n++;
+  }
+  out[n] = '\0';
+  rec->len += n + 1;
+}
+
+void log_commit(log_record *rec) {
+  uint16_t used = head - tail;
+  if (used + 1 + rec->len > LOG_BUFFER_SIZE) {
+    dropped++;
+    return;
+  }
+  ring[head++ & (LOG_BUFFER_SIZE - 1)] = rec->len;
+  for (int i = 0; i < rec->len; i++) {
+    ring[head++ & (LOG_BUFFER_SIZE - 1)] = rec->bytes[i];
+  }
+}
+
+// Takes the oldest message out of the ring
+static bool take_record(log_record *rec) {
+  if (head == tail) {
+    return false;
+  }
+  rec->len = ring[tail++ & (LOG_BUFFER_SIZE - 1)];
+  for (int i = 0; i < rec->len; i++) {
+    rec->bytes[i] = ring[tail++ & (LOG_BUFFER_SIZE - 1)];
+  }
+  return true;
+}
+
+static void append_char(char c) {
+  if (line_len < LOG_MAX_RECORD) {
+    line[line_len++] = c;
+  }
+}
+
+static void append_string(const char *s) {
+  while (*s != '\0') {
+    append_char(*s++);
+  }
+}
+
+static void append_number(uint32_t value, int base) {
+  char digits[sizeof(value) * 3 + 1];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789abcdef"[value % base];
+    value /= base;
+  } while (value > 0);
+  while (n > 0) {
+    append_char(digits[--n]);
+  }
+}
+
+// Formats a message into the line, pulling its arguments out in the
+// order the format asks for them
+static void format_record(const log_record *rec) {
+  const char *format;
+  memcpy(&format, rec->bytes, sizeof(format));
+  int pos = sizeof(format);
+
+  line_len = 0;
+  line_pos = 0;
+  for (const char *f = format; *f != '\0'; f++) {
+    if (*f != '%' || f[1] == '\0') {
+      append_char(*f);
+      continue;
+    }
+    char spec = *++f;
+    if (spec == 's') {
+      const char *s = (const char *) rec->bytes + pos;
+      if (pos < rec->len) {
+        append_string(s);
+        pos += strlen(s) + 1;
+      }
+    } else if (spec == 'd' || spec == 'u' || spec == 'x') {
+      uint32_t value = 0;
+      if (pos + (int) sizeof(value) <= rec->len) {
+        memcpy(&value, rec->bytes + pos, sizeof(value));
+        pos += sizeof(value);
+      }
+      if (spec == 'd' && (int32_t) value < 0) {
+        append_char('-');
+        value = -value;
+      }
+      append_number(value, spec == 'x' ? 16 : 10);
+    } else {
+      append_char(spec);
+    }
+  }
+  line[line_len++] = '\r';
+  line[line_len++] = '\n';
+}
+
+// Writes out what the serial port will take right now.  Returns true if
+// it took some and there's more waiting.
+bool log_drain(void) {
+#if LOG_LEVEL > LOG_LEVEL_NONE
+  if (line_pos == line_len) {
+    log_record rec = {};
+    if (!take_record(&rec)) {
+      // Messages were dropped after everything that was in the buffer
+      if (dropped == 0) {
+        return false;
+      }
+      log_begin(&rec, "log: dropped %u messages");
+      log_arg(&rec, dropped);
+      dropped = 0;
+    }
+    format_record(&rec);
+  }
+
+  int room = Serial.availableForWrite();
+  int n = min(room, line_len - line_pos);
+  if (n > 0) {
+    Serial.write((const uint8_t *) line + line_pos, n);
+    line_pos += n;
+  }
+  return n > 0 && (line_pos < line_len || head != tail || dropped > 0);
+#else
+  return false;
+#endif
+}
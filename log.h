@@ -0,0 +1,122 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LOG_H_
+#define __LOG_H_
+
+/*
+ * Deferred logging.  LOG_INFO("Hour %d: %dF", i, temp) doesn't format
+ * anything; it copies a pointer to the format string and the raw
+ * arguments into a RAM ring buffer, which takes a few microseconds.
+ * log_drain() formats the oldest message and writes as much of it as the
+ * serial port will take without waiting, and the main loop only calls it
+ * when no task is due, so logging never holds up a fetch or a frame.
+ *
+ * Formats understand %d and %u (any integer up to 32 bits), %x, %s and
+ * %%.  String literals stay in flash on the M0, so a format costs no RAM;
+ * %s arguments are copied, up to LOG_MAX_STRING characters, since they
+ * rarely live as long as the message waits.  Each message is one line.
+ *
+ * Messages above LOG_LEVEL (from config.h) aren't compiled in, and
+ * without DEBUG there's no serial port, so nothing is.  When the buffer
+ * is full, new messages are dropped and counted.
+ */
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef DEBUG
+#undef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_NONE
+#endif
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Must be a power of two
+#define LOG_BUFFER_SIZE 1024
+#define LOG_MAX_STRING  48
+// The most one message can take in the buffer: a length byte, the format,
+// and its arguments
+#define LOG_MAX_RECORD  128
+
+typedef struct {
+  uint8_t len;
+  uint8_t bytes[LOG_MAX_RECORD];
+} log_record;
+
+void log_begin(log_record *rec, const char *format);
+void log_commit(log_record *rec);
+void log_arg(log_record *rec, unsigned long value);
+void log_arg(log_record *rec, const char *value);
+bool log_drain(void);
+
+inline void log_arg(log_record *rec, long value) {
+  log_arg(rec, (unsigned long) value);
+}
+inline void log_arg(log_record *rec, int value) {
+  log_arg(rec, (unsigned long) (long) value);
+}
+inline void log_arg(log_record *rec, unsigned int value) {
+  log_arg(rec, (unsigned long) value);
+}
+
+inline void log_args(log_record *rec) {
+}
+
+template<typename T, typename... Rest>
+inline void log_args(log_record *rec, T value, Rest... rest) {
+  log_arg(rec, value);
+  log_args(rec, rest...);
+}
+
+template<typename... Args>
+void log_event(const char *format, Args... args) {
+  log_record rec;
+  log_begin(&rec, format);
+  log_args(&rec, args...);
+  log_commit(&rec);
+}
+
+// Compiles to nothing, but still uses the arguments so variables that are
+// only logged don't draw warnings
+#define LOG_NOTHING(...) do { if (0) log_event(__VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) log_event(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) log_event(__VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) log_event(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#endif /* __LOG_H_ */
@@ -0,0 +1,97 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500 
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "polygon.h"
+
+void polygon_test_init(polygon_test *test, int32_t x, int32_t y) {
+  test->x = x;
+  test->y = y;
+  test->ring_points = 0;
+  test->rings = 0;
+  test->inside = false;
+}
+
+// Toggles the inside flag if the edge (x0,y0)-(x1,y1) crosses the ray that
+// runs from the test point toward +x.
+static void polygon_test_edge(polygon_test *test, int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+  if ((y0 > test->y) == (y1 > test->y)) {
+    return;
+  }
+
+  // The crossing is right of the point when
+  //   test->x < x0 + (x1 - x0) * (test->y - y0) / (y1 - y0)
+  // Multiply through by (y1 - y0) to stay in integers, flipping the
+  // comparison when that's negative.
+  int64_t lhs = (int64_t) (test->x - x0) * (y1 - y0);
+  int64_t rhs = (int64_t) (x1 - x0) * (test->y - y0);
+  if (y1 > y0 ? lhs < rhs : lhs > rhs) {
+    test->inside = !test->inside;
+  }
+}
+
+void polygon_test_add_point(polygon_test *test, int32_t x, int32_t y) {
+  if (test->ring_points == 0) {
+    test->first_x = x;
+    test->first_y = y;
+  } else {
+    polygon_test_edge(test, test->last_x, test->last_y, x, y);
+  }
+  test->last_x = x;
+  test->last_y = y;
+  test->ring_points++;
+}
+
+void polygon_test_end_ring(polygon_test *test) {
+  // GeoJSON rings repeat the first point at the end, but close the ring
+  // anyway in case one doesn't.  A zero-length edge never crosses.
+  if (test->ring_points > 0) {
+    polygon_test_edge(test, test->last_x, test->last_y, test->first_x, test->first_y);
+    test->rings++;
+  }
+  test->ring_points = 0;
+}
+
+int32_t parse_microdegrees(const char *str) {
+  bool negative = *str == '-';
+  if (negative) {
+    str++;
+  }
+
+  int32_t whole = 0;
+  for (; *str >= '0' && *str <= '9'; str++) {
+    whole = whole * 10 + (*str - '0');
+    if (whole > 360) {
+      // Not a coordinate
+      return 0;
+    }
+  }
+
+  // Digits past the sixth decimal place are dropped
+  int32_t micro = 0;
+  if (*str == '.') {
+    str++;
+    for (int32_t scale = 100000; *str >= '0' && *str <= '9'; str++) {
+      micro += (*str - '0') * scale;
+      scale /= 10;
+    }
+  }
+
+  int32_t value = whole * 1000000 + micro;
+  return negative ? -value : value;
+}
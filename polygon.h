@@ -0,0 +1,59 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500 
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __POLYGON_H_
+#define __POLYGON_H_
+
+#include <stdint.h>
+
+/*
+ * Streaming point-in-polygon test.  Vertices are fed one at a time as they
+ * are read, so a polygon of any size is tested in constant memory.  Uses
+ * the even-odd ray casting rule, which also handles holes and multiple
+ * polygons (as long as they don't overlap).
+ *
+ * Coordinates are fixed-point microdegrees, which keeps the M0 out of the
+ * soft-float library and is finer than anything the NWS publishes.
+ */
+typedef struct {
+  // The point being tested
+  int32_t x;
+  int32_t y;
+
+  // First and most recent vertex of the current ring
+  int32_t first_x;
+  int32_t first_y;
+  int32_t last_x;
+  int32_t last_y;
+  uint16_t ring_points;
+
+  // Number of complete rings seen
+  uint16_t rings;
+  // Toggled every time an edge crosses the ray from the point
+  bool inside;
+} polygon_test;
+
+void polygon_test_init(polygon_test *test, int32_t x, int32_t y);
+void polygon_test_add_point(polygon_test *test, int32_t x, int32_t y);
+void polygon_test_end_ring(polygon_test *test);
+
+// Parses a decimal degrees string like "-78.90387" into microdegrees
+int32_t parse_microdegrees(const char *str);
+
+#endif /* __POLYGON_H_ */
@@ -0,0 +1,279 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+#include <malloc.h>
+
+#include "config.h"
+#include "profile.h"
+#include "sched.h"
+#include "scratch.h"
+
+#ifdef PROFILE
+
+typedef struct {
+  unsigned long count;
+  unsigned long max_us;
+  // Counts stop at 65535 rather than wrapping
+  uint16_t buckets[PROFILE_BUCKETS];
+} probe_stats;
+
+static probe_stats probes[PROBE_COUNT];
+
+static const char *probe_names[PROBE_COUNT] = {
+  "loop",
+  "sleep",
+  "weather",
+  "wifi",
+  "frame late",
+  "animate",
+  "composite",
+  "show",
+  "http connect",
+  "http headers",
+  "http body",
+};
+
+static const char *phase_names[PHASE_COUNT] = {
+  "geocode",
+  "alerts",
+  "forecast",
+  "frame",
+};
+
+// Deepest each phase has taken the stack, in bytes from the top
+static unsigned long phase_depths[PHASE_COUNT];
+
+// What unused stack is painted with
+#define STACK_PAINT 0xa5a5a5a5UL
+// How much room to leave under the painter's own variables, in words
+#define STACK_PAINT_MARGIN 16
+
+#ifdef ARDUINO_ARCH_SAMD
+extern "C" char *sbrk(int incr);
+// From the linker script: the stack starts at the top of RAM
+extern uint32_t __StackTop;
+static uint32_t *stack_top = &__StackTop;
+
+// The heap grows up toward the stack, so only what's above it is stack
+static uint32_t *stack_floor(void) {
+  return (uint32_t *) (((uintptr_t) sbrk(0) + 3) & ~3);
+}
+#else
+#define HOST_STACK_BYTES 32768
+static uint32_t *stack_top;
+
+static uint32_t *stack_floor(void) {
+  return stack_top - HOST_STACK_BYTES / 4;
+}
+
+// Grows the host's stack through the room that's measured, so painting
+// and scanning it only touch memory the stack already has.  The array is
+// volatile so the stores aren't optimized away.
+static void __attribute__((noinline)) reserve_stack(void) {
+  volatile uint32_t room[HOST_STACK_BYTES / 4 + 256];
+  for (size_t i = 0; i < sizeof(room) / sizeof(room[0]); i++) {
+    room[i] = 0;
+  }
+}
+#endif
+
+// The lowest word of the stack that's been written since it was painted.
+// Arrays that were never filled can leave paint above it, so this scans up
+// from the bottom rather than down from the top.
+static uint32_t *stack_low_water(void) {
+  uint32_t *p = stack_floor();
+  while (p < stack_top && *p == STACK_PAINT) {
+    p++;
+  }
+  return p;
+}
+
+// Paints from the given word up to just under the caller's stack frame.
+// The pointer is volatile so the loop doesn't become a call to memset(),
+// whose own frame would be in the way.
+static void paint_stack(uint32_t *from) {
+  uint32_t here;
+  volatile uint32_t *p = from;
+  uint32_t *to = (uint32_t *) ((uintptr_t) &here - STACK_PAINT_MARGIN * sizeof(uint32_t));
+  while (p < to) {
+    *p++ = STACK_PAINT;
+  }
+}
+
+// Deepest the stack has been since boot, in bytes from the top
+static unsigned long stack_peak = 0;
+
+static void note_stack_peak(uint32_t *low) {
+  unsigned long depth = (stack_top - low) * sizeof(uint32_t);
+  if (depth > stack_peak) {
+    stack_peak = depth;
+  }
+}
+
+void profile_stack_begin(void) {
+  uint32_t *low = stack_low_water();
+  note_stack_peak(low);
+  paint_stack(low);
+}
+
+void profile_stack_end(phase p) {
+  uint32_t *low = stack_low_water();
+  note_stack_peak(low);
+  unsigned long depth = (stack_top - low) * sizeof(uint32_t);
+  if (depth > phase_depths[p]) {
+    phase_depths[p] = depth;
+  }
+}
+
+unsigned long profile_stack_depth(phase p) {
+  return phase_depths[p];
+}
+
+// Frames left until the next one whose stack is measured
+static uint16_t frames_until_stack = 0;
+
+bool profile_frame_stack_due(void) {
+  if (frames_until_stack > 0) {
+    frames_until_stack--;
+    return false;
+  }
+  frames_until_stack = PROFILE_FRAME_STACK_EVERY - 1;
+  return true;
+}
+
+static void print_memory(void) {
+  note_stack_peak(stack_low_water());
+  // What's left between the deepest the stack has gone and the heap
+  unsigned long room = (stack_top - stack_floor()) * sizeof(uint32_t);
+  Serial.print("memory: stack peak ");
+  Serial.print(stack_peak);
+  Serial.print(" bytes, ");
+  Serial.print(room > stack_peak ? room - stack_peak : 0);
+  Serial.print(" to spare |");
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    Serial.print(' ');
+    Serial.print(phase_names[p]);
+    Serial.print(' ');
+    Serial.print(phase_depths[p]);
+  }
+  Serial.println();
+
+  // Free chunks are what's left between allocations; the more pieces the
+  // free space is in, the smaller the largest thing that can be allocated
+#ifdef __GLIBC__
+  struct mallinfo2 info = mallinfo2();
+#else
+  struct mallinfo info = mallinfo();
+#endif
+  Serial.print("memory: heap used ");
+  Serial.print((unsigned long) info.uordblks);
+  Serial.print(" bytes, free ");
+  Serial.print((unsigned long) info.fordblks);
+  Serial.print(" bytes in ");
+  Serial.print((unsigned long) info.ordblks);
+  Serial.print(" pieces, ");
+  Serial.print((unsigned long) info.keepcost);
+  Serial.println(" of it at the top");
+
+  Serial.print("memory: scratch high water ");
+  Serial.print((unsigned long) scratch_high_water());
+  Serial.print(" of ");
+  Serial.print((unsigned long) SCRATCH_SIZE);
+  Serial.println(" bytes");
+}
+
+void profile_record(probe p, unsigned long us) {
+  probe_stats *stats = &probes[p];
+  stats->count++;
+  if (us > stats->max_us) {
+    stats->max_us = us;
+  }
+  int bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  if (bucket >= PROFILE_BUCKETS) {
+    bucket = PROFILE_BUCKETS - 1;
+  }
+  if (stats->buckets[bucket] < 0xffff) {
+    stats->buckets[bucket]++;
+  }
+}
+
+// One line per probe that has run: its count and maximum, then each
+// bucket that isn't empty as bucket:count
+static void print_profile(void) {
+  for (int p = 0; p < PROBE_COUNT; p++) {
+    probe_stats *stats = &probes[p];
+    if (stats->count == 0) {
+      continue;
+    }
+    Serial.print("profile: ");
+    Serial.print(probe_names[p]);
+    Serial.print(" n ");
+    Serial.print(stats->count);
+    Serial.print(" max ");
+    Serial.print(stats->max_us);
+    Serial.print(" us |");
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+      if (stats->buckets[b] > 0) {
+        Serial.print(' ');
+        Serial.print(b);
+        Serial.print(':');
+        Serial.print(stats->buckets[b]);
+      }
+    }
+    Serial.println();
+  }
+}
+
+void profile_clear(void) {
+  memset(probes, 0, sizeof(probes));
+  memset(phase_depths, 0, sizeof(phase_depths));
+  frames_until_stack = 0;
+}
+
+// Answers commands from the serial port
+static unsigned long profile_loop(unsigned long now) {
+  while (Serial.available() > 0) {
+    switch (Serial.read()) {
+      case 'p':
+        print_profile();
+        break;
+      case 'm':
+        print_memory();
+        break;
+      case 'r':
+        profile_clear();
+        Serial.println("profile: cleared");
+        break;
+    }
+  }
+  return 100;
+}
+
+void profile_setup(void) {
+#ifndef ARDUINO_ARCH_SAMD
+  uint32_t here;
+  stack_top = &here;
+  reserve_stack();
+#endif
+  paint_stack(stack_floor());
+  sched_add("profile", profile_loop, 50);
+}
+
+#endif /* PROFILE */
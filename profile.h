@@ -0,0 +1,112 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PROFILE_H_
+#define __PROFILE_H_
+
+// Places where the loop's latency is measured
+typedef enum {
+  // A task run by the scheduler, whichever it was
+  PROBE_LOOP,
+  // Sleeping between tasks
+  PROBE_SLEEP,
+  // A whole weather poll, all its requests included
+  PROBE_WEATHER,
+  // Asking the WiFi module for the connection status
+  PROBE_WIFI,
+  // How late a light frame started, mostly from waiting on other tasks
+  PROBE_FRAME_LATE,
+  // The phases of a light frame
+  PROBE_ANIMATE,
+  PROBE_COMPOSITE,
+  PROBE_SHOW,
+  // The phases of an HTTP request: connecting, sending the request and
+  // reading the response headers, and handing the body to its callback
+  PROBE_HTTP_CONNECT,
+  PROBE_HTTP_HEADERS,
+  PROBE_HTTP_BODY,
+  PROBE_COUNT,
+} probe;
+
+// Stretches of work whose deepest stack use is measured
+typedef enum {
+  // Looking up the location's latitude and longitude
+  PHASE_GEOCODE,
+  // Fetching and parsing the active alerts
+  PHASE_ALERTS,
+  // Fetching and parsing the hourly forecast
+  PHASE_FORECAST,
+  // Drawing a light frame
+  PHASE_FRAME,
+  PHASE_COUNT,
+} phase;
+
+/*
+ * With PROFILE defined in config.h, each probe keeps a count, a maximum
+ * and a histogram of its times in microseconds.  Bucket n counts times
+ * that take n bits, so bucket 0 is 0 us, bucket 1 is 1 us, bucket 2 is
+ * 2-3 us, bucket 10 is 512-1023 us, and the last holds everything longer.
+ * Send 'p' over the serial port to print them, 'r' to clear them.
+ *
+ * The free stack is also painted with a pattern at boot, so the deepest
+ * the stack has gone shows as the lowest word that's been overwritten.
+ * Each phase repaints what's under it before it starts, and keeps the
+ * deepest it reached.  Finding the deepest point scans the stack up from
+ * the heap, which takes longer than a whole frame's drawing, so only one
+ * light frame in PROFILE_FRAME_STACK_EVERY is measured, starting with the
+ * first after boot or 'r'.  Send 'm' to print the depths, along with how
+ * much of the heap is used and free, and how many pieces the free part is
+ * in.  Host builds measure the stack in as much room as the board has,
+ * below wherever profile_setup() was called from, which profile_setup()
+ * reserves before painting it.
+ *
+ * Without PROFILE the probes compile to nothing.
+ */
+#ifdef PROFILE
+
+#define PROFILE_BUCKETS 26
+// Every five seconds at the usual frame rate
+#define PROFILE_FRAME_STACK_EVERY 250
+
+void profile_setup(void);
+void profile_record(probe p, unsigned long us);
+void profile_stack_begin(void);
+void profile_stack_end(phase p);
+// Deepest the phase has taken the stack, in bytes
+unsigned long profile_stack_depth(phase p);
+// Forgets every time and depth, as 'r' does
+void profile_clear(void);
+// Whether this light frame is one whose stack is measured
+bool profile_frame_stack_due(void);
+
+#define PROFILE_START(t) unsigned long t = micros()
+#define PROFILE_END(p, t) profile_record(p, micros() - (t))
+#define PROFILE_STACK_BEGIN() profile_stack_begin()
+#define PROFILE_STACK_END(p) profile_stack_end(p)
+
+#else
+
+#define PROFILE_START(t)
+#define PROFILE_END(p, t)
+#define PROFILE_STACK_BEGIN()
+#define PROFILE_STACK_END(p)
+
+#endif /* PROFILE */
+
+#endif /* __PROFILE_H_ */
@@ -21,6 +21,9 @@
 #include "config.h"
 #include "weather.h"
 #include "lights.h"
+#include "sched.h"
+#include "profile.h"
+#include "log.h"
 
 void setup() {
 #ifdef DEBUG
@@ -36,9 +39,18 @@ void setup() {
 
   lights_setup();
   weather_setup();
+#ifdef PROFILE
+  profile_setup();
+#endif
 }
 
 void loop() {
-  weather_loop();
-  lights_loop();
+  if (sched_loop()) {
+    return;
+  }
+  // Log messages go out when there's nothing else to do, and once the
+  // serial port won't take any more, sleep until the next task is due
+  if (!log_drain()) {
+    sched_idle();
+  }
 }
@@ -0,0 +1,149 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+#include <limits.h>
+
+#include "config.h"
+#include "sched.h"
+#include "profile.h"
+#include "log.h"
+
+static sched_task tasks[SCHED_MAX_TASKS];
+static int task_count = 0;
+static void wfi_sleep(unsigned long ms);
+
+static sched_clock clock_fn = millis;
+static sched_sleep sleep_fn = wfi_sleep;
+
+/*
+   Sleeps the CPU until the time is up.  WFI stops the core until the next
+   interrupt, which is at most a millisecond away since that's how often
+   the tick millis() counts comes, so this wakes to check and goes back to
+   sleep.  Standby would save more, but it stops that tick and the USB
+   port, and the WiFi module's interrupt needs answering.
+*/
+static void wfi_sleep(unsigned long ms) {
+  unsigned long until = millis() + ms;
+  while (!time_reached(millis(), until)) {
+#ifdef ARDUINO_ARCH_SAMD
+    __WFI();
+#else
+    yield();
+#endif
+  }
+}
+
+unsigned long sched_now(void) {
+  return clock_fn();
+}
+
+void sched_set_clock(sched_clock clock, sched_sleep sleep) {
+  clock_fn = clock;
+  sleep_fn = sleep;
+  // Deadlines from the old clock mean nothing on the new one
+  unsigned long now = sched_now();
+  for (int i = 0; i < task_count; i++) {
+    tasks[i].due = now;
+  }
+}
+
+// New tasks are due right away
+sched_task *sched_add(const char *name, sched_fn run, unsigned long budget_ms) {
+  if (task_count >= SCHED_MAX_TASKS) {
+    LOG_ERROR("sched: no room for task %s", name);
+    return NULL;
+  }
+  sched_task *task = &tasks[task_count++];
+  memset(task, 0, sizeof(*task));
+  task->name = name;
+  task->run = run;
+  task->budget_ms = budget_ms;
+  task->due = sched_now();
+  return task;
+}
+
+// Make a task due now, for when something it waits on has changed
+void sched_wake(sched_task *task) {
+  if (task != NULL) {
+    task->due = sched_now();
+  }
+}
+
+// Milliseconds until the next task is due, 0 if one already is
+unsigned long sched_idle_ms(void) {
+  unsigned long now = sched_now();
+  unsigned long idle = ULONG_MAX;
+  for (int i = 0; i < task_count; i++) {
+    if (time_reached(now, tasks[i].due)) {
+      return 0;
+    }
+    idle = min(idle, tasks[i].due - now);
+  }
+  return idle;
+}
+
+// Runs the task that's most overdue, if any are due.  Returns true if it
+// ran one.
+bool sched_loop(void) {
+  unsigned long now = sched_now();
+
+  // The most overdue task goes first
+  sched_task *next = NULL;
+  for (int i = 0; i < task_count; i++) {
+    sched_task *task = &tasks[i];
+    if (time_reached(now, task->due) &&
+        (next == NULL || now - task->due > now - next->due)) {
+      next = task;
+    }
+  }
+  if (next == NULL) {
+    return false;
+  }
+
+  PROFILE_START(run_start);
+  unsigned long wait = next->run(now);
+  PROFILE_END(PROBE_LOOP, run_start);
+  unsigned long done = sched_now();
+  unsigned long took = done - now;
+  // The next run counts from when this one started, so a task's period
+  // doesn't drift by however long it takes
+  next->due = now + min(wait, SCHED_MAX_WAIT_MS);
+
+  if (took > next->worst_ms) {
+    next->worst_ms = took;
+  }
+  if (took > next->budget_ms) {
+    next->overruns++;
+    LOG_INFO("sched: %s took %u ms, budget %u ms, %u overruns", next->name, took, next->budget_ms, next->overruns);
+  }
+  return true;
+}
+
+// Sleeps until the next task is due.  Nothing but a task can make another
+// one due sooner, so there's no need to wake early.
+void sched_idle(void) {
+  unsigned long ms = sched_idle_ms();
+  if (ms == 0 || ms == ULONG_MAX) {
+    return;
+  }
+  PROFILE_START(sleep_start);
+  sleep_fn(ms);
+  PROFILE_END(PROBE_SLEEP, sleep_start);
+}
@@ -0,0 +1,78 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SCHED_H_
+#define __SCHED_H_
+
+/*
+ * A small run-to-completion scheduler.  Each task is a function that does
+ * its work and returns how many milliseconds until it wants to run again.
+ * sched_loop() runs whichever due task has waited longest past its
+ * deadline, so one slow task can delay the others but never starve them.
+ *
+ * When no task is due, sched_idle() sleeps until one is.  Tasks that
+ * have nothing to do for a while should say so in what they return, so
+ * the CPU can sleep through it.
+ *
+ * All times are milliseconds from the scheduler's clock, which is millis()
+ * unless sched_set_clock() swaps in another one, along with a way to
+ * sleep on it.  A virtual clock whose sleep just moves it ahead runs the
+ * firmware as fast as the host can go.  Times wrap every 49 days; compare
+ * them with time_reached(), never with < or >=.
+ */
+
+#define SCHED_MAX_TASKS 5
+// The longest a task can ask to wait.  time_reached() can only tell which
+// side of now a deadline is within half the clock's range, and a task
+// with nothing to do, like the lights with every layer off, may ask for
+// ULONG_MAX, which would come around to just behind now.  Tasks woken by
+// sched_wake() don't wait this long anyway.
+#define SCHED_MAX_WAIT_MS (1000UL * 60 * 60 * 24)
+
+typedef unsigned long (*sched_clock)(void);
+// Waits the given milliseconds on the clock
+typedef void (*sched_sleep)(unsigned long ms);
+
+// Runs a task; returns the milliseconds until it should run again
+typedef unsigned long (*sched_fn)(unsigned long now);
+
+typedef struct {
+  const char *name;
+  sched_fn run;
+  // A run that takes longer than this is reported as an overrun
+  unsigned long budget_ms;
+  unsigned long due;
+  unsigned long overruns;
+  unsigned long worst_ms;
+} sched_task;
+
+// True once now is at or past when, across millis() wrapping
+inline bool time_reached(unsigned long now, unsigned long when) {
+  return (long) (now - when) >= 0;
+}
+
+sched_task *sched_add(const char *name, sched_fn run, unsigned long budget_ms);
+void sched_wake(sched_task *task);
+void sched_set_clock(sched_clock clock, sched_sleep sleep);
+unsigned long sched_now(void);
+unsigned long sched_idle_ms(void);
+bool sched_loop(void);
+void sched_idle(void);
+
+#endif /* __SCHED_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "log.h"
+#include "scratch.h"
+
+// Words rather than bytes so every allocation is aligned for anything
+static uint32_t arena[SCRATCH_SIZE / sizeof(uint32_t)];
+// Bytes in use, from the start
+static size_t used = 0;
+static size_t high_water = 0;
+// The high-water mark last logged
+static size_t reported = 0;
+
+void *scratch_alloc(size_t size) {
+  size = (size + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+  if (size > SCRATCH_SIZE - used) {
+    LOG_ERROR("scratch: no room for %u bytes, %u of %u in use", size, used, SCRATCH_SIZE);
+    return NULL;
+  }
+  void *p = (uint8_t *) arena + used;
+  used += size;
+  if (used > high_water) {
+    high_water = used;
+  }
+  return p;
+}
+
+size_t scratch_mark(void) {
+  return used;
+}
+
+void scratch_release(size_t mark) {
+  used = mark;
+  // Once a request has given everything back, say if it set a new record
+  if (used == 0 && high_water > reported) {
+    LOG_INFO("scratch: high water %u of %u bytes", high_water, SCRATCH_SIZE);
+    reported = high_water;
+  }
+}
+
+size_t scratch_high_water(void) {
+  return high_water;
+}
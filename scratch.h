@@ -0,0 +1,53 @@
+/*
+ * Pufflux for the Adafruit Feather M0 WiFi - ATSAMD21 + ATWINC1500
+ * (Product ID: 3010)
+ *
+ * Copyright 2013-2022 Shaw Terwilliger <sterwill@tinfig.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SCRATCH_H_
+#define __SCRATCH_H_
+
+#include <stddef.h>
+
+/*
+ * Scratch memory for the big buffers a weather request needs for a
+ * little while: paths, response bodies, HTTP lines and JSON tokens.
+ * Allocations come off the end of one static arena, and a scratch_scope
+ * gives back everything allocated while it was alive when it goes out of
+ * scope, so the arena only ever needs to be as big as the hungriest
+ * request.
+ *
+ * The geocode lookup needs the most: a path, its whole body and the
+ * tokens parsed out of it, after the HTTP line buffer has been given back.
+ */
+#define SCRATCH_SIZE (12 * 1024)
+
+// Returns size bytes, word aligned, or NULL if there isn't room
+void *scratch_alloc(size_t size);
+size_t scratch_mark(void);
+void scratch_release(size_t mark);
+// The most of the arena that's been in use at once
+size_t scratch_high_water(void);
+
+// Everything allocated from the arena while one of these is alive is
+// released when it goes out of scope
+typedef struct scratch_scope {
+  size_t mark;
+  scratch_scope() : mark(scratch_mark()) {}
+  ~scratch_scope() { scratch_release(mark); }
+} scratch_scope;
+
+#endif /* __SCRATCH_H_ */
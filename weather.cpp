@@ -26,6 +26,12 @@
 #include "urlencode.h"
 #include "util.h"
 #include "lights.h"
+#include "polygon.h"
+#include "json_stream.h"
+#include "sched.h"
+#include "profile.h"
+#include "log.h"
+#include "scratch.h"
 
 // Arbitrary categories of types of VTEC "phenomena" (pp) field
 typedef enum {
@@ -121,6 +127,57 @@ int pp_cats[][3] = {
   {'T', 'O', CAT_TORNADO},
 };
 
+// Mappings of NWS alert "event" names to our own categories and significance.
+// VTEC covers most products, but some (like Special Weather Statements) carry
+// none, so we also recognize alerts by name.  Names are matched exactly.
+typedef struct {
+  const char *name;
+  phen_cat cat;
+  phen_sig sig;
+} event_cat;
+
+const event_cat event_cats[] = {
+  {"Air Quality Alert",           CAT_AIR_QUALITY, SIG_ADVISTORY},
+  {"Blizzard Warning",            CAT_SNOW,        SIG_WARNING},
+  {"Blowing Dust Advisory",       CAT_DUST,        SIG_ADVISTORY},
+  {"Dense Fog Advisory",          CAT_FOG,         SIG_ADVISTORY},
+  {"Dust Storm Warning",          CAT_DUST,        SIG_WARNING},
+  {"Excessive Heat Warning",      CAT_HEAT,        SIG_WARNING},
+  {"Extreme Cold Warning",        CAT_COLD,        SIG_WARNING},
+  {"Fire Weather Watch",          CAT_FIRE,        SIG_WATCH},
+  {"Flash Flood Statement",       CAT_FLOOD,       SIG_STATEMENT},
+  {"Flash Flood Warning",         CAT_FLOOD,       SIG_WARNING},
+  {"Flash Flood Watch",           CAT_FLOOD,       SIG_WATCH},
+  {"Flood Advisory",              CAT_FLOOD,       SIG_ADVISTORY},
+  {"Flood Statement",             CAT_FLOOD,       SIG_STATEMENT},
+  {"Flood Warning",               CAT_FLOOD,       SIG_WARNING},
+  {"Flood Watch",                 CAT_FLOOD,       SIG_WATCH},
+  {"Freeze Warning",              CAT_FREEZE,      SIG_WARNING},
+  {"Frost Advisory",              CAT_FREEZE,      SIG_ADVISTORY},
+  {"Heat Advisory",               CAT_HEAT,        SIG_ADVISTORY},
+  {"High Wind Warning",           CAT_WIND,        SIG_WARNING},
+  {"Hurricane Local Statement",   CAT_STORM,       SIG_STATEMENT},
+  {"Hurricane Warning",           CAT_STORM,       SIG_WARNING},
+  {"Hurricane Watch",             CAT_STORM,       SIG_WATCH},
+  {"Hydrologic Outlook",          CAT_FLOOD,       SIG_OUTLOOK},
+  {"Ice Storm Warning",           CAT_ICE,         SIG_WARNING},
+  {"Marine Weather Statement",    CAT_MARINE,      SIG_STATEMENT},
+  {"Red Flag Warning",            CAT_FIRE,        SIG_WARNING},
+  {"Severe Thunderstorm Warning", CAT_STORM,       SIG_WARNING},
+  {"Severe Thunderstorm Watch",   CAT_STORM,       SIG_WATCH},
+  {"Severe Weather Statement",    CAT_STORM,       SIG_STATEMENT},
+  {"Special Weather Statement",   CAT_STORM,       SIG_STATEMENT},
+  {"Tornado Warning",             CAT_TORNADO,     SIG_WARNING},
+  {"Tornado Watch",               CAT_TORNADO,     SIG_WATCH},
+  {"Tropical Storm Warning",      CAT_STORM,       SIG_WARNING},
+  {"Tropical Storm Watch",        CAT_STORM,       SIG_WATCH},
+  {"Wind Advisory",               CAT_WIND,        SIG_ADVISTORY},
+  {"Wind Chill Advisory",         CAT_COLD,        SIG_ADVISTORY},
+  {"Winter Storm Warning",        CAT_SNOW,        SIG_WARNING},
+  {"Winter Storm Watch",          CAT_SNOW,        SIG_WATCH},
+  {"Winter Weather Advisory",     CAT_SNOW,        SIG_ADVISTORY},
+};
+
 // Most recently read alert phenomena and significance
 phen_cat most_significant_cat;
 phen_sig most_significant_sig;
@@ -137,6 +194,17 @@ phen_cat lookup_phen_cat(char p0, char p1) {
   return CAT_UNKNOWN;
 }
 
+bool lookup_event(const char *name, phen_cat *cat, phen_sig *sig) {
+  for (int i = 0; i < (sizeof(event_cats) / sizeof(event_cats[0])); i++) {
+    if (strcmp(event_cats[i].name, name) == 0) {
+      *cat = event_cats[i].cat;
+      *sig = event_cats[i].sig;
+      return true;
+    }
+  }
+  return false;
+}
+
 phen_sig lookup_phen_sig(char s0) {
   switch (s0) {
     case 'W':
@@ -191,9 +259,13 @@ bool parse_vtec(const char *p_vtec, phen_cat *cat, phen_sig *sig) {
   return true;
 }
 
+// Longest request path, including its terminator
+#define PATH_SIZE 128
+
 typedef struct {
   // Response body buffer
-  char buf[2048];
+  char *buf;
+  size_t size;
   // Write position in buffer
   size_t pos;
 } get_full_body_ctx;
@@ -202,14 +274,50 @@ void get_full_body_cb(http_request *req) {
   get_full_body_ctx * ctx = (get_full_body_ctx*) req->caller_ctx;
 
   // Read the whole body
-  while (req->client->connected() && ctx->pos < sizeof(ctx->buf) - 1) {
-    int c = req->client->read();
-    if (c != -1) {
-      ctx->buf[ctx->pos++] = (char) c;
-    }
+  while (!http_body_done(req) && ctx->pos < ctx->size - 1) {
+    ctx->pos += http_read_body(req, (uint8_t*) ctx->buf + ctx->pos, ctx->size - 1 - ctx->pos);
   }
 }
 
+// Where the event name matcher is in a '"event": "Name"' property
+typedef enum {
+  EVENT_MATCHING_KEY,
+  EVENT_BEFORE_COLON,
+  EVENT_BEFORE_VALUE,
+  EVENT_IN_VALUE,
+} event_match_state;
+
+// Streaming state for following feature boundaries and geometry through a
+// GeoJSON FeatureCollection without buffering any of it
+typedef struct {
+  // JSON nesting depth outside of strings
+  uint8_t depth;
+  bool in_string;
+  bool escaped;
+
+  // Chars of "coordinates" matched in the current string, or -1 if it
+  // isn't that
+  int8_t key_pos;
+  // The most recent string was "coordinates"
+  bool last_string_was_coords;
+  // We just read the "coordinates" key, so its value is next
+  bool coords_pending;
+  // Array depth inside the coordinates value, 0 when outside it
+  uint8_t coords_depth;
+
+  // Chars of the coordinate number being read
+  char num[16];
+  uint8_t num_pos;
+  // Numbers read so far in the current position array, which is [lon, lat]
+  uint8_t pos_count;
+  int32_t pos[2];
+  // A position in the current feature wasn't [lon, lat]
+  bool bad_position;
+
+  // Tests our location against the current feature's polygons
+  polygon_test polygon;
+} feature_scan;
+
 typedef struct {
   // Most recently read chars.  We need enough to hold a full
   // P-VTEC string, which is exactly 48 chars.
@@ -221,22 +329,215 @@ typedef struct {
   phen_cat  cat;
   // Highest significance VTEC
   phen_sig sig;
+
+  // Most significant phenomenon in the feature being read.  It only counts
+  // once we know the feature's geometry covers our location.
+  bool feature_found;
+  phen_cat feature_cat;
+  phen_sig feature_sig;
+  feature_scan scan;
+
+  // Streaming state for finding "event" property values
+  event_match_state event_state;
+  // Chars of the "event" key matched so far
+  size_t event_key_pos;
+  // The event name being read, and write position in it
+  char event_name[48];
+  size_t event_name_pos;
 } parse_vtecs_ctx;
 
+// Feeds one character to the event name matcher.  Returns true when a
+// complete "event" property value has been read into ctx->event_name.
+bool match_event_name(parse_vtecs_ctx *ctx, char c) {
+  static const char key[] = "\"event\"";
+
+  switch (ctx->event_state) {
+    case EVENT_MATCHING_KEY:
+      if (c == key[ctx->event_key_pos]) {
+        ctx->event_key_pos++;
+        if (ctx->event_key_pos == sizeof(key) - 1) {
+          ctx->event_state = EVENT_BEFORE_COLON;
+          ctx->event_key_pos = 0;
+        }
+      } else {
+        // A quote is the only char that can start the key over
+        ctx->event_key_pos = c == '"' ? 1 : 0;
+      }
+      return false;
+    case EVENT_BEFORE_COLON:
+      if (c == ':') {
+        ctx->event_state = EVENT_BEFORE_VALUE;
+      } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        // Not a property name after all
+        ctx->event_state = EVENT_MATCHING_KEY;
+        ctx->event_key_pos = c == '"' ? 1 : 0;
+      }
+      return false;
+    case EVENT_BEFORE_VALUE:
+      if (c == '"') {
+        ctx->event_state = EVENT_IN_VALUE;
+        ctx->event_name_pos = 0;
+      } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        // Not a string value
+        ctx->event_state = EVENT_MATCHING_KEY;
+      }
+      return false;
+    case EVENT_IN_VALUE:
+      if (c == '"') {
+        ctx->event_state = EVENT_MATCHING_KEY;
+        ctx->event_name[ctx->event_name_pos] = '\0';
+        return true;
+      }
+      if (c == '\\' || ctx->event_name_pos == sizeof(ctx->event_name) - 1) {
+        // Too long or escaped, so it can't be one of ours.  Escaped quotes
+        // in the rest of the value can't complete the key, so it's safe to
+        // go back to looking for it.
+        ctx->event_state = EVENT_MATCHING_KEY;
+        return false;
+      }
+      ctx->event_name[ctx->event_name_pos++] = c;
+      return false;
+  }
+  return false;
+}
+
 void rotate_left(char array[], size_t size) {
   if (size < 2) {
     return;
   }
   char head = array[0];
-  for (int i = 0; i < size; i++) {
+  for (size_t i = 0; i < size - 1; i++) {
     array[i] = array[i + 1];
   }
   array[size - 1] = head;
 }
 
-void parse_vtecs_cb(http_request *req) {
-  parse_vtecs_ctx * ctx = (parse_vtecs_ctx*) req->caller_ctx;
-  memset(ctx->buf, 0, sizeof(ctx->buf));
+// Finishes any number being read inside a coordinates array
+void scan_end_number(feature_scan *scan) {
+  if (scan->num_pos == 0) {
+    return;
+  }
+  scan->num[scan->num_pos] = '\0';
+  if (scan->pos_count < 2) {
+    scan->pos[scan->pos_count] = parse_microdegrees(scan->num);
+  }
+  scan->pos_count++;
+  scan->num_pos = 0;
+}
+
+// Feeds one character to the feature scanner.  Returns true when a feature
+// object (an object nested directly in the "features" array) ends.
+bool scan_feature(feature_scan *scan, char c) {
+  static const char coords_key[] = "coordinates";
+
+  if (scan->in_string) {
+    if (scan->escaped) {
+      scan->escaped = false;
+      scan->key_pos = -1;
+    } else if (c == '\\') {
+      scan->escaped = true;
+      scan->key_pos = -1;
+    } else if (c == '"') {
+      scan->in_string = false;
+      scan->last_string_was_coords = scan->key_pos == sizeof(coords_key) - 1;
+    } else if (scan->key_pos >= 0) {
+      scan->key_pos = coords_key[scan->key_pos] == c ? scan->key_pos + 1 : -1;
+    }
+    return false;
+  }
+
+  if (scan->coords_depth > 0 && ((c >= '0' && c <= '9') || c == '-' || c == '.')) {
+    if (scan->num_pos < sizeof(scan->num) - 1) {
+      scan->num[scan->num_pos++] = c;
+    }
+    return false;
+  }
+  scan_end_number(scan);
+
+  if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+    return false;
+  }
+
+  bool value_is_coords = scan->coords_pending;
+  scan->coords_pending = false;
+
+  switch (c) {
+    case '"':
+      scan->in_string = true;
+      scan->key_pos = 0;
+      scan->last_string_was_coords = false;
+      break;
+    case ':':
+      scan->coords_pending = scan->last_string_was_coords;
+      break;
+    case '[':
+      scan->depth++;
+      if (scan->coords_depth > 0 || value_is_coords) {
+        scan->coords_depth++;
+        scan->pos_count = 0;
+      }
+      break;
+    case ']':
+      scan->depth--;
+      if (scan->coords_depth > 0) {
+        if (scan->pos_count > 0) {
+          // End of a position
+          if (scan->pos_count == 2) {
+            polygon_test_add_point(&scan->polygon, scan->pos[0], scan->pos[1]);
+          } else {
+            scan->bad_position = true;
+          }
+          scan->pos_count = 0;
+        } else if (scan->polygon.ring_points > 0) {
+          // End of a ring of positions
+          polygon_test_end_ring(&scan->polygon);
+        }
+        scan->coords_depth--;
+      }
+      break;
+    case '{':
+      scan->depth++;
+      break;
+    case '}':
+      scan->depth--;
+      // The collection is depth 1, "features" is 2, each feature is 3
+      return scan->depth == 2;
+  }
+  return false;
+}
+
+// Remembers a phenomenon found in the current feature if it's the most
+// significant one so far
+void note_phenomenon(parse_vtecs_ctx *ctx, phen_cat cat, phen_sig sig) {
+  if (!ctx->feature_found || sig >= ctx->feature_sig) {
+    ctx->feature_found = true;
+    ctx->feature_cat = cat;
+    ctx->feature_sig = sig;
+  }
+}
+
+// Ends the current feature.  Its phenomenon counts if the feature has no
+// polygons (zone-based alerts) or if its polygons contain our location.
+// Polygons we couldn't read count as containing it, since missing an alert
+// is worse than showing one for a nearby county.
+void end_feature(parse_vtecs_ctx *ctx) {
+  polygon_test *polygon = &ctx->scan.polygon;
+  bool applies = polygon->rings == 0 || polygon->inside || ctx->scan.bad_position;
+
+  if (ctx->feature_found && applies && ctx->feature_sig >= ctx->sig) {
+    ctx->cat = ctx->feature_cat;
+    ctx->sig = ctx->feature_sig;
+  }
+
+  ctx->feature_found = false;
+  ctx->scan.bad_position = false;
+  polygon_test_init(polygon, polygon->x, polygon->y);
+}
+
+// Parses the next len bytes of an alerts response body.  The body can be
+// fed in pieces of any size, so a recorded response can be replayed with
+// whatever read pattern we want to test.
+void parse_alerts_chunk(parse_vtecs_ctx *ctx, const char *chunk, size_t len) {
   phen_cat cat;
   phen_sig sig;
 
@@ -244,11 +545,8 @@ void parse_vtecs_cb(http_request *req) {
   // have a P-VTEC string there to parse.  The buffer is big enough for
   // exactly one P-VTEC string, so we shift down by one to make room.
   // This is not very CPU efficient, but it's very memory efficient.
-  while (req->client->connected()) {
-    char c = req->client->read();
-    if (c == -1) {
-      break;
-    }
+  for (size_t i = 0; i < len; i++) {
+    char c = chunk[i];
 
     // If we're at the end of the buffer, shift everything to the left
     // one character.
@@ -258,39 +556,99 @@ void parse_vtecs_cb(http_request *req) {
     }
 
     // Read one character
-    ctx->buf[ctx->pos++] = (char) c;
+    ctx->buf[ctx->pos++] = c;
 
     // Try to parse it as a P-VTEC.  If it is, and it's more significant than
     // previously parsed ones, keep it.
     if (parse_vtec(ctx->buf, &cat, &sig)) {
-      if (sig >= ctx->sig) {
-        ctx->cat = cat;
-        ctx->sig = sig;
-      }
+      note_phenomenon(ctx, cat, sig);
+    }
+
+    // Products without VTEC are recognized by their event names instead.
+    // Names are only checked as "event" property values, so mentions of
+    // other alerts in description text don't count.
+    if (match_event_name(ctx, c) && lookup_event(ctx->event_name, &cat, &sig)) {
+      note_phenomenon(ctx, cat, sig);
+    }
+
+    // Polygons are tested as their coordinates stream by.  When a feature
+    // ends, we know whether what we found in it applies to us.
+    if (scan_feature(&ctx->scan, c)) {
+      end_feature(ctx);
+    }
+  }
+}
+
+// Finishes parsing an alerts response body
+void parse_alerts_end(parse_vtecs_ctx *ctx) {
+  // In case the body ended mid-feature
+  end_feature(ctx);
+}
+
+// Logs how much of a body we read, how long it took, and how much of
+// that was spent parsing, so parser changes show up as numbers
+void print_body_stats(const char *what, size_t bytes, unsigned long total_ms, unsigned long parse_us) {
+  if (parse_us > 0) {
+    LOG_INFO("%s body: %u bytes in %u ms, %u ms parsing (%u bytes/sec)", what, bytes, total_ms, parse_us / 1000,
+             (unsigned long) ((uint64_t) bytes * 1000000 / parse_us));
+  } else {
+    LOG_INFO("%s body: %u bytes in %u ms, %u ms parsing", what, bytes, total_ms, parse_us / 1000);
+  }
+}
+
+void parse_vtecs_cb(http_request *req) {
+  parse_vtecs_ctx * ctx = (parse_vtecs_ctx*) req->caller_ctx;
+  memset(ctx->buf, 0, sizeof(ctx->buf));
+
+  char chunk[64];
+  size_t bytes = 0;
+  unsigned long parse_us = 0;
+  unsigned long start = millis();
+
+  while (!http_body_done(req)) {
+    int read = http_read_body(req, (uint8_t*) chunk, sizeof(chunk));
+    if (read == 0) {
+      continue;
     }
+    unsigned long parse_start = micros();
+    parse_alerts_chunk(ctx, chunk, read);
+    parse_us += micros() - parse_start;
+    bytes += read;
   }
+  parse_alerts_end(ctx);
+
+  print_body_stats("Alerts", bytes, millis() - start, parse_us);
 }
 
 bool parse_geocode_response(const char *json, char *lat, size_t lat_size, char *lon, size_t lon_size) {
   const int tokens_size = 500;
-  jsmntok_t tokens[tokens_size];
+  scratch_scope scope;
+  jsmntok_t *tokens = (jsmntok_t*) scratch_alloc(tokens_size * sizeof(jsmntok_t));
+  if (tokens == NULL) {
+    return false;
+  }
   jsmn_parser parser;
 
   jsmn_init(&parser);
-  int num_tokens = jsmn_parse(&parser, json, strlen(json), tokens, tokens_size);
+  size_t json_len = strlen(json);
+  unsigned long parse_start = micros();
+  int num_tokens = jsmn_parse(&parser, json, json_len, tokens, tokens_size);
+  unsigned long parse_us = micros() - parse_start;
   if (num_tokens < 0) {
-    Serial.println("Failed to parse the geocode JSON");
+    LOG_ERROR("Failed to parse the geocode JSON");
     return false;
   }
 
+  LOG_INFO("Geocode parse: %u bytes in %u us, %d of %u tokens", json_len, parse_us, num_tokens, tokens_size);
+
   if (num_tokens < 1 || tokens[0].type != JSMN_OBJECT) {
-    Serial.println("Top level geocode item was not an object.");
+    LOG_ERROR("Top level geocode item was not an object.");
     return false;
   }
 
   int locations_i = find_json_prop(json, tokens, num_tokens, 0, "locations");
   if (locations_i == -1) {
-    Serial.println("JSON missing locations");
+    LOG_ERROR("JSON missing locations");
     return false;
   }
 
@@ -299,31 +657,31 @@ bool parse_geocode_response(const char *json, char *lat, size_t lat_size, char *
   // in a general way.
   int first_location_i = locations_i + 1;
   if (tokens[first_location_i].type != JSMN_OBJECT) {
-    Serial.println("JSON missing locations[0]");
+    LOG_ERROR("JSON missing locations[0]");
     return false;
   }
 
   int feature_i = find_json_prop(json, tokens, num_tokens, first_location_i, "feature");
   if (feature_i == -1) {
-    Serial.println("JSON missing locations[0].feature");
+    LOG_ERROR("JSON missing locations[0].feature");
     return false;
   }
 
   int geometry_i = find_json_prop(json, tokens, num_tokens, feature_i, "geometry");
   if (geometry_i == -1) {
-    Serial.println("JSON missing locations[0].feature.geometry");
+    LOG_ERROR("JSON missing locations[0].feature.geometry");
     return false;
   }
 
   int x_i = find_json_prop(json, tokens, num_tokens, geometry_i, "x");
   if (x_i == -1) {
-    Serial.println("JSON missing locations[0].feature.geometry.x");
+    LOG_ERROR("JSON missing locations[0].feature.geometry.x");
     return false;
   }
 
   int y_i = find_json_prop(json, tokens, num_tokens, geometry_i, "y");
   if (y_i == -1) {
-    Serial.println("JSON missing locations[0].feature.geometry.y");
+    LOG_ERROR("JSON missing locations[0].feature.geometry.y");
     return false;
   }
 
@@ -337,21 +695,29 @@ bool parse_geocode_response(const char *json, char *lat, size_t lat_size, char *
 }
 
 bool resolve_location_to_lat_lon(const char *location, char *lat, size_t lat_size, char *lon, size_t lon_size) {
-  Serial.print("Resolving location: ");
-  Serial.println(location);
+  LOG_INFO("Resolving location: %s", location);
 
-  char path[128];
-  memset(path, 0, sizeof(path));
+  scratch_scope scope;
+  char *path = (char*) scratch_alloc(PATH_SIZE);
+  if (path == NULL) {
+    return false;
+  }
+  memset(path, 0, PATH_SIZE);
   int path_i = strlen(path);
 
-  strncpy(path + path_i, "/arcgis/rest/services/World/GeocodeServer/find?f=json&text=", sizeof(path) - path_i - 1);
+  strncpy(path + path_i, "/arcgis/rest/services/World/GeocodeServer/find?f=json&text=", PATH_SIZE - path_i - 1);
   path_i = strlen(path);
-  strncpy(path + path_i, location, sizeof(path) - path_i - 1);
+  strncpy(path + path_i, location, PATH_SIZE - path_i - 1);
   path_i = strlen(path);
 
   // The whole response can fit in memory
   get_full_body_ctx ctx;
   memset(&ctx, 0, sizeof(ctx));
+  ctx.size = 2048;
+  ctx.buf = (char*) scratch_alloc(ctx.size);
+  if (ctx.buf == NULL) {
+    return false;
+  }
 
   http_request req;
   http_request_init(&req);
@@ -366,50 +732,56 @@ bool resolve_location_to_lat_lon(const char *location, char *lat, size_t lat_siz
   http_get(&req);
 
   if (req.status != 200) {
-    Serial.print("HTTP error getting geocode: ");
-    Serial.println(req.status, DEC);
+    LOG_ERROR("HTTP error getting geocode: %d", req.status);
     return false;
   }
 
   if (ctx.pos == 0) {
-    Serial.println("Got empty geocode response");
+    LOG_ERROR("Got empty geocode response");
     return false;
   }
 
   // Ensure the response is NUL-terminated so we can use it as a normal string.
-  ctx.buf[min(ctx.pos, sizeof(ctx.buf) - 1)] = '\0';
+  ctx.buf[min(ctx.pos, ctx.size - 1)] = '\0';
 
-  Serial.print("Geocode response: ");
-  Serial.println(ctx.buf);
+  LOG_DEBUG("Geocode response: %s", ctx.buf);
 
   if (!parse_geocode_response(ctx.buf, lat, lat_size, lon, lon_size)) {
-    Serial.println("Error parsing response");
+    LOG_ERROR("Error parsing response");
     return false;
   }
 
-  Serial.print("Resolved location to: ");
-  Serial.print(lat);
-  Serial.print(",");
-  Serial.println(lon);
+  LOG_INFO("Resolved location to: %s,%s", lat, lon);
 
   return true;
 }
 
 bool get_active_alert(const char *lat, const char *lon, phen_cat *cat, phen_sig *sig) {
-  Serial.println("Getting alerts");
+  LOG_INFO("Getting alerts");
 
-  char path[128];
-  memset(path, 0, sizeof(path));
+  scratch_scope scope;
+  char *path = (char*) scratch_alloc(PATH_SIZE);
+  if (path == NULL) {
+    return false;
+  }
+  memset(path, 0, PATH_SIZE);
   int path_i = strlen(path);
 
-  strncpy(path + path_i, "/alerts/active?status=actual&point=", sizeof(path) - path_i - 1);
+#ifdef NWS_ALERT_ZONE
+  strncpy(path + path_i, "/alerts/active?status=actual&zone=", PATH_SIZE - path_i - 1);
   path_i = strlen(path);
-  strncpy(path + path_i, lat, sizeof(path) - path_i - 1);
+  strncpy(path + path_i, NWS_ALERT_ZONE, PATH_SIZE - path_i - 1);
   path_i = strlen(path);
-  strncpy(path + path_i, "%2C", sizeof(path) - path_i - 1);
+#else
+  strncpy(path + path_i, "/alerts/active?status=actual&point=", PATH_SIZE - path_i - 1);
   path_i = strlen(path);
-  strncpy(path + path_i, lon, sizeof(path) - path_i - 1);
+  strncpy(path + path_i, lat, PATH_SIZE - path_i - 1);
   path_i = strlen(path);
+  strncpy(path + path_i, "%2C", PATH_SIZE - path_i - 1);
+  path_i = strlen(path);
+  strncpy(path + path_i, lon, PATH_SIZE - path_i - 1);
+  path_i = strlen(path);
+#endif
 
   // Alert responses may be so large they can't fit in memory.  Use a
   // streaming body callback that just extracts VTEC strings.
@@ -417,6 +789,8 @@ bool get_active_alert(const char *lat, const char *lon, phen_cat *cat, phen_sig
   memset(&ctx, 0, sizeof(ctx));
   ctx.cat = CAT_UNKNOWN;
   ctx.sig = SIG_UNKNOWN;
+  // GeoJSON positions are [lon, lat]
+  polygon_test_init(&ctx.scan.polygon, parse_microdegrees(lon), parse_microdegrees(lat));
 
   http_request req;
   http_request_init(&req);
@@ -431,8 +805,7 @@ bool get_active_alert(const char *lat, const char *lon, phen_cat *cat, phen_sig
   http_get(&req);
 
   if (req.status != 200) {
-    Serial.print("HTTP error getting alerts: ");
-    Serial.println(req.status, DEC);
+    LOG_ERROR("HTTP error getting alerts: %d", req.status);
     return false;
   }
 
@@ -441,6 +814,289 @@ bool get_active_alert(const char *lat, const char *lon, phen_cat *cat, phen_sig
   return true;
 }
 
+#if FORECAST_HOURS > 0
+// Words in an hourly forecast's "shortForecast" that tell us what kind of
+// precipitation to show, checked in order
+typedef struct {
+  const char *word;
+  color precip_color;
+} precip_word;
+
+const precip_word precip_words[] = {
+  {"Thunder",  COLOR_YELLOW},
+  {"Snow",     COLOR_WHITE},
+  {"Flurries", COLOR_WHITE},
+  {"Sleet",    COLOR_LIGHT_BLUE},
+  {"Freezing", COLOR_LIGHT_BLUE},
+  {"Rain",     COLOR_BLUE},
+  {"Showers",  COLOR_BLUE},
+  {"Drizzle",  COLOR_BLUE},
+  {"Fog",      COLOR_LIGHT_GRAY},
+};
+
+color lookup_precip_color(const char *short_forecast) {
+  for (int i = 0; i < (sizeof(precip_words) / sizeof(precip_words[0])); i++) {
+    if (strstr(short_forecast, precip_words[i].word) != NULL) {
+      return precip_words[i].precip_color;
+    }
+  }
+  return COLOR_BLACK;
+}
+
+// Reads the whole body through the json_stream in caller_ctx, stopping
+// early if the stream's callbacks are done with it
+void json_stream_body_cb(http_request *req) {
+  json_stream *js = (json_stream*) req->caller_ctx;
+
+  char chunk[64];
+  size_t bytes = 0;
+  unsigned long parse_us = 0;
+  unsigned long start = millis();
+
+  while (!http_body_done(req) && !js->done) {
+    int read = http_read_body(req, (uint8_t*) chunk, sizeof(chunk));
+    if (read == 0) {
+      continue;
+    }
+    unsigned long parse_start = micros();
+    for (int i = 0; i < read && !js->done; i++) {
+      json_stream_feed(js, chunk[i]);
+    }
+    parse_us += micros() - parse_start;
+    bytes += read;
+  }
+
+  print_body_stats("JSON", bytes, millis() - start, parse_us);
+}
+
+typedef struct {
+  // Path of the hourly forecast URL
+  char *path;
+  size_t path_size;
+  bool found;
+} parse_points_ctx;
+
+void parse_points_value_cb(json_stream *js, const char *key, const char *value) {
+  parse_points_ctx *ctx = (parse_points_ctx*) js->caller_ctx;
+
+  // We want properties.forecastHourly
+  if (js->depth == 2 && strcmp(key, "forecastHourly") == 0) {
+    url_parts parts;
+    if (parse_url(&parts, value) && strcmp(parts.host, "api.weather.gov") == 0) {
+      memset(ctx->path, 0, ctx->path_size);
+      strncpy(ctx->path, parts.path_and_query, ctx->path_size - 1);
+      ctx->found = true;
+    }
+    js->done = true;
+  }
+}
+
+// Appends a decimal degrees string cut to the four decimal places the
+// points API accepts without redirecting, and without trailing zeros
+void append_points_coord(char *path, size_t path_size, const char *coord) {
+  int path_i = strlen(path);
+  int decimals = -1;
+
+  while (*coord != '\0' && decimals < 4 && path_i < path_size - 1) {
+    if (decimals >= 0 || *coord == '.') {
+      decimals++;
+    }
+    path[path_i++] = *coord++;
+  }
+  while (decimals > 0 && path[path_i - 1] == '0') {
+    path[--path_i] = '\0';
+    decimals--;
+  }
+  if (decimals == 0) {
+    path[--path_i] = '\0';
+  }
+}
+
+// Finds the path of the hourly forecast for the NWS grid square that
+// contains lat, lon
+bool resolve_forecast_path(const char *lat, const char *lon, char *forecast_path, size_t forecast_path_size) {
+  LOG_INFO("Resolving forecast grid");
+
+  scratch_scope scope;
+  char *path = (char*) scratch_alloc(PATH_SIZE);
+  if (path == NULL) {
+    return false;
+  }
+  memset(path, 0, PATH_SIZE);
+  int path_i = strlen(path);
+
+  strncpy(path + path_i, "/points/", PATH_SIZE - path_i - 1);
+  append_points_coord(path, PATH_SIZE, lat);
+  path_i = strlen(path);
+  strncpy(path + path_i, ",", PATH_SIZE - path_i - 1);
+  append_points_coord(path, PATH_SIZE, lon);
+
+  // The response is a few KB of things we don't need, so stream it
+  parse_points_ctx ctx;
+  ctx.path = forecast_path;
+  ctx.path_size = forecast_path_size;
+  ctx.found = false;
+
+  json_stream js;
+  json_stream_init(&js);
+  js.value_cb = parse_points_value_cb;
+  js.caller_ctx = &ctx;
+
+  http_request req;
+  http_request_init(&req);
+  req.host = "api.weather.gov";
+  req.port = 443;
+  req.ssl = true;
+  req.path_and_query = path;
+  req.header_cb = NULL;
+  req.body_cb = json_stream_body_cb;
+  req.caller_ctx = &js;
+
+  http_get(&req);
+
+  if (req.status != 200) {
+    LOG_ERROR("HTTP error getting forecast grid: %d", req.status);
+    return false;
+  }
+
+  if (!ctx.found) {
+    LOG_ERROR("JSON missing properties.forecastHourly");
+    return false;
+  }
+
+  LOG_INFO("Hourly forecast path: %s", forecast_path);
+  return true;
+}
+
+typedef struct {
+  int16_t temperature;
+  uint8_t precip_chance;
+  char short_forecast[32];
+} hourly_period;
+
+typedef struct {
+  // The next hours of the forecast, in order
+  hourly_period periods[FORECAST_HOURS];
+  uint8_t count;
+
+  // Depth of values in the "periods" array, 0 until we find it
+  uint8_t periods_depth;
+  // Reading the probabilityOfPrecipitation object of a period
+  bool in_precip;
+} parse_forecast_ctx;
+
+void parse_forecast_open_cb(json_stream *js, const char *key) {
+  parse_forecast_ctx *ctx = (parse_forecast_ctx*) js->caller_ctx;
+
+  if (ctx->periods_depth == 0) {
+    // properties.periods
+    if (js->depth == 3 && strcmp(key, "periods") == 0) {
+      ctx->periods_depth = js->depth;
+    }
+  } else if (ctx->count == FORECAST_HOURS) {
+    return;
+  } else if (js->depth == ctx->periods_depth + 1) {
+    // A new period
+    hourly_period *period = &ctx->periods[ctx->count];
+    memset(period, 0, sizeof(hourly_period));
+  } else if (js->depth == ctx->periods_depth + 2) {
+    ctx->in_precip = strcmp(key, "probabilityOfPrecipitation") == 0;
+  }
+}
+
+void parse_forecast_close_cb(json_stream *js) {
+  parse_forecast_ctx *ctx = (parse_forecast_ctx*) js->caller_ctx;
+
+  if (ctx->periods_depth == 0) {
+    return;
+  }
+  if (js->depth == ctx->periods_depth + 2) {
+    ctx->in_precip = false;
+  } else if (js->depth == ctx->periods_depth + 1) {
+    // We have enough once the array is full; don't read the rest
+    ctx->count++;
+    js->done = ctx->count == FORECAST_HOURS;
+  } else if (js->depth == ctx->periods_depth) {
+    js->done = true;
+  }
+}
+
+void parse_forecast_value_cb(json_stream *js, const char *key, const char *value) {
+  parse_forecast_ctx *ctx = (parse_forecast_ctx*) js->caller_ctx;
+
+  if (ctx->periods_depth == 0 || ctx->count == FORECAST_HOURS) {
+    return;
+  }
+  hourly_period *period = &ctx->periods[ctx->count];
+  if (js->depth == ctx->periods_depth + 1) {
+    if (strcmp(key, "temperature") == 0) {
+      period->temperature = atoi(value);
+    } else if (strcmp(key, "shortForecast") == 0) {
+      strncpy(period->short_forecast, value, sizeof(period->short_forecast) - 1);
+    }
+  } else if (ctx->in_precip && strcmp(key, "value") == 0) {
+    // null when there's no chance
+    period->precip_chance = atoi(value);
+  }
+}
+
+// Gets the next FORECAST_HOURS hours of the hourly forecast.  The response
+// covers a week and is far bigger than RAM, so it's streamed, and we stop
+// reading once we have what we need.
+bool get_hourly_forecast(const char *path, forecast_hour *hours, uint8_t *count) {
+  LOG_INFO("Getting hourly forecast");
+
+  parse_forecast_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+
+  json_stream js;
+  json_stream_init(&js);
+  js.open_cb = parse_forecast_open_cb;
+  js.close_cb = parse_forecast_close_cb;
+  js.value_cb = parse_forecast_value_cb;
+  js.caller_ctx = &ctx;
+
+  http_request req;
+  http_request_init(&req);
+  req.host = "api.weather.gov";
+  req.port = 443;
+  req.ssl = true;
+  req.path_and_query = path;
+  req.header_cb = NULL;
+  req.body_cb = json_stream_body_cb;
+  req.caller_ctx = &js;
+
+  http_get(&req);
+
+  if (req.status != 200) {
+    LOG_ERROR("HTTP error getting hourly forecast: %d", req.status);
+    return false;
+  }
+
+  if (ctx.count == 0) {
+    LOG_ERROR("Hourly forecast had no periods");
+    return false;
+  }
+
+  for (int i = 0; i < ctx.count; i++) {
+    hourly_period *period = &ctx.periods[i];
+    hours[i].temperature = period->temperature;
+    hours[i].precip_chance = period->precip_chance;
+    hours[i].precip_color = lookup_precip_color(period->short_forecast);
+
+    LOG_INFO("Hour %d: %dF, %u%%, %s", i, period->temperature, period->precip_chance, period->short_forecast);
+  }
+  *count = ctx.count;
+  return true;
+}
+#endif /* FORECAST_HOURS > 0 */
+
+// Polls the weather service; woken early when the WiFi comes back
+static sched_task *weather_task;
+
+static unsigned long weather_loop(unsigned long now);
+static unsigned long wifi_loop(unsigned long now);
+
 void weather_setup(void) {
   WiFi.setPins(8, 7, 4, 2);
   WiFi.begin(WIFI_SSID, WIFI_PASSPHRASE);
@@ -448,6 +1104,11 @@ void weather_setup(void) {
   memset(encoded_location, 0, sizeof(encoded_location));
   String loc = urlencode(NWS_LOCATION);
   strncpy(encoded_location, loc.c_str(), sizeof(encoded_location) - 1);
+
+  // A poll makes several requests, each of which can wait on the network
+  // for a while; checking the WiFi only talks to the WiFi module
+  weather_task = sched_add("weather", weather_loop, 1000UL * 30);
+  sched_add("wifi", wifi_loop, 100);
 }
 
 const char *get_status_description(int status) {
@@ -473,97 +1134,180 @@ const char *get_status_description(int status) {
   }
 }
 
-void weather_loop(void) {
-  static unsigned long next_time = 0;
+// A slow orange pulse over everything while we can't get the weather, so
+// stale lights don't pass for current ones
+static void show_weather_trouble(bool trouble) {
+  static bool showing = false;
+  if (trouble == showing) {
+    return;
+  }
+  if (trouble) {
+    lights_configure_layer(LAYER_STATUS, ANIM_PULSE, false, COLOR_BLACK, COLOR_ORANGE);
+    lights_set_layer_blend(LAYER_STATUS, BLEND_ADD, 96);
+  } else {
+    lights_set_layer_blend(LAYER_STATUS, BLEND_NORMAL, 0);
+  }
+  showing = trouble;
+}
+
+// Updates the lights from the weather, and returns the milliseconds until
+// it should be checked again
+static unsigned long poll_weather(void) {
   static char lat[10];
   static char lon[10];
   static bool lat_lon_resolved = false;
+#if FORECAST_HOURS > 0
+  static char forecast_path[64];
+  static bool forecast_path_resolved = false;
+#endif
+
+  if (WiFi.status() != WL_CONNECTED) {
+    // wifi_loop() wakes us up when the connection comes back
+    LOG_ERROR("Not connected");
+    show_weather_trouble(true);
+    return 1000UL * 60 * FORECAST_PERIOD_MINUTES;
+  }
+  LOG_INFO("Connected");
 
-  unsigned long now = millis();
-  if (now >= next_time) {
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("Not connected");
-      next_time = now + (1000 * 2);
-      return;
-    }
-    Serial.println("Connected");
-
-    // Resolve the location to lat, lon
+  // Resolve the location to lat, lon
+  if (!lat_lon_resolved) {
+    PROFILE_STACK_BEGIN();
+    lat_lon_resolved = resolve_location_to_lat_lon(encoded_location, lat, sizeof(lat), lon, sizeof(lon));
+    PROFILE_STACK_END(PHASE_GEOCODE);
     if (!lat_lon_resolved) {
-      lat_lon_resolved = resolve_location_to_lat_lon(encoded_location, lat, sizeof(lat), lon, sizeof(lon));
-      if (!lat_lon_resolved) {
-        next_time = now + (1000 * 10);
-        return;
-      }
+      show_weather_trouble(true);
+      return 1000UL * 10;
     }
+  }
 
-    // Get the most significant phenomenon for current alerts.
-    phen_cat cat;
-    phen_sig sig;
-    if (!get_active_alert(lat, lon, &cat, &sig)) {
-      next_time = now + (1000 * 10);
-      return;
-    }
+  // Get the most significant phenomenon for current alerts.
+  phen_cat cat;
+  phen_sig sig;
+  PROFILE_STACK_BEGIN();
+  bool got_alert = get_active_alert(lat, lon, &cat, &sig);
+  PROFILE_STACK_END(PHASE_ALERTS);
+  if (!got_alert) {
+    show_weather_trouble(true);
+    return 1000UL * 10;
+  }
+  show_weather_trouble(false);
+
+  // Most alerts take over the whole base layer; the overlay is only for
+  // the ones drawn over something calmer.  It stays on while it's still
+  // wanted, so a tornado's swirl doesn't start over every poll.
+  if (cat != CAT_TORNADO) {
+    lights_set_layer_blend(LAYER_OVERLAY, BLEND_NORMAL, 0);
+  }
 
-    Serial.print("Active phenomenon category: ");
-    Serial.println(cat);
-    Serial.print("Significance: ");
-    Serial.println(sig);
-
-    // Update the lights.  Warnings get high speed, all else low.
-    bool fast = sig == SIG_WARNING;
-    switch (cat) {
-      case CAT_AIR_QUALITY:
-        lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_YELLOW);
-        break;
-      case CAT_COLD:
-        lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_DARK_BLUE);
-        break;
-      case CAT_HEAT:
-        lights_configure(ANIM_PULSE, fast, COLOR_WHITE, COLOR_ORANGE);
-        break;
-      case CAT_FLOOD:
-        lights_configure(ANIM_FLOOD, fast, COLOR_BLACK, COLOR_DARK_BLUE);
-        break;
-      case CAT_LOW_WATER:
-        lights_configure(ANIM_FLOOD, fast, COLOR_BLACK, COLOR_YELLOW);
-        break;
-      case CAT_MARINE:
-        lights_configure(ANIM_FLOOD, fast, COLOR_DARK_BLUE, COLOR_LIGHT_BLUE);
-        break;
-      case CAT_SNOW:
-        lights_configure(ANIM_PRECIP, fast, COLOR_BLACK, COLOR_WHITE);
-        break;
-      case CAT_WIND:
-        lights_configure(ANIM_SWIRL, fast, COLOR_DARK_GRAY, COLOR_LIGHT_GRAY);
-        break;
-      case CAT_DUST:
-        lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_YELLOW);
-        break;
-      case CAT_FOG:
-        lights_configure(ANIM_PULSE, fast, COLOR_DARK_GRAY, COLOR_LIGHT_GRAY);
-        break;
-      case CAT_FREEZE:
-        lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_LIGHT_BLUE);
-        break;
-      case CAT_FIRE:
-        lights_configure(ANIM_PULSE, fast, COLOR_BLACK, COLOR_ORANGE);
-        break;
-      case CAT_STORM:
-        lights_configure(ANIM_PRECIP, fast, COLOR_DARK_BLUE, COLOR_LIGHT_BLUE);
-        break;
-      case CAT_ICE:
-        lights_configure(ANIM_PRECIP, fast, COLOR_BLACK, COLOR_LIGHT_BLUE);
-        break;
-      case CAT_TORNADO:
-        lights_configure(ANIM_SWIRL, fast, COLOR_WHITE, COLOR_RED);
-        break;
-      default:
-        // This animation doesn't care about speed or colors
-        lights_configure(ANIM_DEFAULT, fast, COLOR_BLACK, COLOR_BLACK);
-        break;
+  LOG_INFO("Active phenomenon category: %d", cat);
+  LOG_INFO("Significance: %d", sig);
+
+#if FORECAST_HOURS > 0
+  // With no alerts, show the forecast.  If we can't get it, fall back
+  // to the default animation.
+  if (cat == CAT_UNKNOWN) {
+    PROFILE_STACK_BEGIN();
+    if (!forecast_path_resolved) {
+      forecast_path_resolved = resolve_forecast_path(lat, lon, forecast_path, sizeof(forecast_path));
+    }
+    forecast_hour hours[FORECAST_HOURS];
+    uint8_t count;
+    bool got_forecast = forecast_path_resolved && get_hourly_forecast(forecast_path, hours, &count);
+    PROFILE_STACK_END(PHASE_FORECAST);
+    if (got_forecast) {
+      lights_set_forecast(hours, count);
+      lights_configure(ANIM_FORECAST, false, COLOR_BLACK, COLOR_BLACK);
+      return 1000UL * 60 * FORECAST_PERIOD_MINUTES;
     }
+  }
+#endif
+
+  // Update the lights.  Warnings get high speed and heavier
+  // precipitation, all else low.
+  bool fast = sig == SIG_WARNING;
+  lights_set_intensity(fast ? 4 : 2);
+  switch (cat) {
+    case CAT_AIR_QUALITY:
+      lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_YELLOW);
+      break;
+    case CAT_COLD:
+      lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_DARK_BLUE);
+      break;
+    case CAT_HEAT:
+      lights_configure(ANIM_PULSE, fast, COLOR_WHITE, COLOR_ORANGE);
+      break;
+    case CAT_FLOOD:
+      lights_configure(ANIM_FLOOD, fast, COLOR_BLACK, COLOR_DARK_BLUE);
+      break;
+    case CAT_LOW_WATER:
+      lights_configure(ANIM_FLOOD, fast, COLOR_BLACK, COLOR_YELLOW);
+      break;
+    case CAT_MARINE:
+      lights_configure(ANIM_FLOOD, fast, COLOR_DARK_BLUE, COLOR_LIGHT_BLUE);
+      break;
+    case CAT_SNOW:
+      lights_configure(ANIM_PRECIP, fast, COLOR_BLACK, COLOR_WHITE);
+      break;
+    case CAT_WIND:
+      lights_configure(ANIM_CHASE, fast, COLOR_DARK_GRAY, COLOR_LIGHT_GRAY);
+      break;
+    case CAT_DUST:
+      lights_configure(ANIM_DRIFT, fast, COLOR_LIGHT_GRAY, COLOR_YELLOW);
+      break;
+    case CAT_FOG:
+      lights_configure(ANIM_DRIFT, fast, COLOR_DARK_GRAY, COLOR_LIGHT_GRAY);
+      break;
+    case CAT_FREEZE:
+      lights_configure(ANIM_PULSE, fast, COLOR_LIGHT_GRAY, COLOR_LIGHT_BLUE);
+      break;
+    case CAT_FIRE:
+      lights_configure(ANIM_PULSE, fast, COLOR_BLACK, COLOR_ORANGE);
+      break;
+    case CAT_STORM:
+      lights_configure(ANIM_PRECIP, fast, COLOR_DARK_BLUE, COLOR_LIGHT_BLUE);
+      break;
+    case CAT_ICE:
+      lights_configure(ANIM_PRECIP, fast, COLOR_BLACK, COLOR_LIGHT_BLUE);
+      break;
+    case CAT_TORNADO:
+      // The swirl circles over the calm default animation, whose black
+      // gaps let it show through
+      lights_configure(ANIM_DEFAULT, false, COLOR_BLACK, COLOR_BLACK);
+      lights_configure_layer(LAYER_OVERLAY, ANIM_SWIRL, fast, COLOR_WHITE, COLOR_RED);
+      lights_set_layer_blend(LAYER_OVERLAY, BLEND_ADD, 255);
+      break;
+    default:
+      // This animation doesn't care about speed or colors
+      lights_configure(ANIM_DEFAULT, fast, COLOR_BLACK, COLOR_BLACK);
+      break;
+  }
+
+  return 1000UL * 60 * FORECAST_PERIOD_MINUTES;
+}
 
-    next_time = now + (1000 * 60 * FORECAST_PERIOD_MINUTES);
+// The weather task
+static unsigned long weather_loop(unsigned long now) {
+  PROFILE_START(poll_start);
+  unsigned long wait = poll_weather();
+  PROFILE_END(PROBE_WEATHER, poll_start);
+  return wait;
+}
+
+// Watches the WiFi connection, so losing it shows right away and getting
+// it back gets the weather without waiting for the next poll
+static unsigned long wifi_loop(unsigned long now) {
+  static int last_status = -1;
+  PROFILE_START(status_start);
+  int status = WiFi.status();
+  PROFILE_END(PROBE_WIFI, status_start);
+  if (status != last_status) {
+    LOG_INFO("WiFi %s", get_status_description(status));
+    if (status == WL_CONNECTED) {
+      sched_wake(weather_task);
+    } else if (last_status == WL_CONNECTED) {
+      show_weather_trouble(true);
+    }
+    last_status = status;
   }
+  return 1000UL * 2;
 }
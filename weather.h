@@ -21,6 +21,5 @@
 #define __WEATHER_H_
 
 void weather_setup(void);
-void weather_loop(void);
 
 #endif /* __WEATER_H_ */